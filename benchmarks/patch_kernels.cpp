@@ -0,0 +1,98 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.hpp"
+
+#include <inpaint/timer.h>
+#include <inpaint/patch_kernels.h>
+#include <inpaint/patch_distance.h>
+#include <opencv2/opencv.hpp>
+#include <iostream>
+
+using namespace Inpaint;
+
+/** Time masked copies of patches of half size H against the generic kernel. */
+template<int H>
+void benchmarkCopy(const cv::Mat &img, const cv::Mat &mask, int niter)
+{
+    cv::Mat dst = img.clone();
+
+    Timer t;
+    for (int i = 0; i < niter; ++i) {
+        copyMaskedPatch<-1>(img, cv::Point(20 + i % 50, 20), dst, cv::Point(50, 50), mask, H);
+    }
+    const double generic = t.measure() * 1000;
+
+    for (int i = 0; i < niter; ++i) {
+        copyMaskedPatch<H>(img, cv::Point(20 + i % 50, 20), dst, cv::Point(50, 50), mask, H);
+    }
+    const double fixed = t.measure() * 1000;
+
+    std::cout << "copyMaskedPatch " << (2 * H + 1) << "x" << (2 * H + 1) << ":  generic " << generic << " msec, fixed " << fixed << " msec." << std::endl;
+}
+
+/** Time masked distances of templates of the given side with and without fixed size kernels. */
+void benchmarkDistance(const cv::Mat &img, int side, int normType, int niter)
+{
+    cv::Mat templ = img(cv::Rect(0, 0, side, side)).clone();
+    cv::Mat mask(side, side, CV_8UC1, cv::Scalar(255));
+    mask(cv::Rect(0, 0, side, side / 2)).setTo(0);
+
+    MaskedPatchDistance d;
+    d.setNormType(normType);
+
+    double msec[2];
+    int64 sum = 0;
+    for (int k = 0; k < 2; ++k) {
+        d.setFixedSizeKernels(k == 1);
+        d.setTemplate(templ, mask);
+
+        Timer t;
+        for (int i = 0; i < niter; ++i) {
+            sum += d(img, i % (img.rows - side), (i / 7) % (img.cols - side));
+        }
+        msec[k] = t.measure() * 1000;
+    }
+
+    std::cout << "MaskedPatchDistance " << (normType == cv::NORM_L1 ? "L1 " : "L2SQR ") << side << "x" << side
+              << ":  generic " << msec[0] << " msec, fixed " << msec[1] << " msec. (" << sum << ")" << std::endl;
+}
+
+TEST_CASE("patch-kernels")
+{
+    cv::Mat img(100, 100, CV_8UC3);
+    cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::Mat mask(img.size(), CV_8UC1);
+    cv::randu(mask, cv::Scalar(0), cv::Scalar(2));
+
+    const int niter = 500000;
+
+    // Patch sizes 5, 7, 9 and 11 are copied with half sizes 2 to 5.
+    benchmarkCopy<2>(img, mask, niter);
+    benchmarkCopy<3>(img, mask, niter);
+    benchmarkCopy<4>(img, mask, niter);
+    benchmarkCopy<5>(img, mask, niter);
+
+    // They are matched with windows of sides 5, 7, 11 and 13.
+    const int sides[] = {5, 7, 11, 13};
+    for (int i = 0; i < 4; ++i) {
+        benchmarkDistance(img, sides[i], cv::NORM_L1, niter);
+        benchmarkDistance(img, sides[i], cv::NORM_L2SQR, niter);
+    }
+}
@@ -17,7 +17,7 @@
    along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <inpaint/criminisi_inpainter.h>
+#include <inpaint/criminisi_async.h>
 
 #include <iostream>
 #include <opencv2/opencv.hpp>
@@ -86,20 +86,27 @@ int main(int argc, char **argv)
     bool done = false;
     bool editingMode = true;
 
-    Inpaint::CriminisiInpainter inpainter;
-    cv::Mat image;
+    // Steps run on a background thread. The UI only copies and redraws regions changed since the last poll.
+    Inpaint::CriminisiAsyncInpainter async;
+    Inpaint::CriminisiInpainter &inpainter = async.inpainter();
+    cv::Mat image, result, remaining;
+    std::vector<cv::Rect> dirty;
     while (!done) {
         if (editingMode) {
             cv::imshow("Image Inpaint", ii.displayImage);
         } else {
-            if (inpainter.hasMoreSteps()) {
-                inpainter.step();
-                inpainter.image().copyTo(image);
-                image.setTo(cv::Scalar(0,250,0), inpainter.targetRegion());
-            } else {
-                ii.image = inpainter.image().clone();
+            const bool finished = async.finished();
+            async.poll(result, remaining, dirty);
+            for (size_t i = 0; i < dirty.size(); ++i) {
+                result(dirty[i]).copyTo(image(dirty[i]));
+                image(dirty[i]).setTo(cv::Scalar(0,250,0), remaining(dirty[i]));
+            }
+
+            if (finished) {
+                async.wait();
+                ii.image = result.clone();
                 ii.displayImage = ii.image.clone();
-                ii.targetMask = inpainter.targetRegion().clone();
+                ii.targetMask = remaining.clone();
                 editingMode = true;
             }
             cv::imshow("Image Inpaint", image);
@@ -116,11 +123,21 @@ int main(int argc, char **argv)
                 inpainter.setTargetMask(ii.targetMask);
                 inpainter.setSourceMask(ii.sourceMask);
                 inpainter.setPatchSize(std::max(2, ii.patchSize));
-                inpainter.initialize();
+
+                result = ii.image.clone();
+                remaining = ii.targetMask.clone();
+                image = result.clone();
+                image.setTo(cv::Scalar(0,250,0), remaining);
+                async.start();
+                editingMode = false;
+            } else {
+                // Stops after the current step, the partial result is taken over once finished.
+                async.cancel();
             }
-            editingMode = !editingMode;
         } else if (key == 'r') {
             // revert
+            async.cancel();
+            async.wait();
             ii.image = inputImage.clone();
             ii.displayImage = ii.image.clone();
             ii.targetMask.create(ii.image.size(), CV_8UC1);
@@ -131,6 +148,9 @@ int main(int argc, char **argv)
         }
     }
 
+    async.cancel();
+    async.wait();
+
     cv::imshow("source", inputImage);
     cv::imshow("final", inpainter.image());
     cv::waitKey();
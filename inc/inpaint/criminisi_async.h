@@ -0,0 +1,128 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef INPAINT_CRIMINISI_ASYNC_H
+#define INPAINT_CRIMINISI_ASYNC_H
+
+#include <inpaint/criminisi_inpainter.h>
+#include <inpaint/progress.h>
+#include <opencv2/core/core.hpp>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace Inpaint {
+
+    /**
+        Runs CriminisiInpainter on a background thread for interactive front ends.
+
+        After each step the worker publishes copies of the modified regions to a lock-free
+        single producer, single consumer queue. Viewers poll these updates into their own
+        snapshot of the result, so they never wait for a step and only copy and redraw the
+        regions that changed.
+    */
+    class CriminisiAsyncInpainter {
+    public:
+
+        /** Empty constructor */
+        CriminisiAsyncInpainter();
+
+        /** Cancels and waits for a running inpainting. */
+        ~CriminisiAsyncInpainter();
+
+        /**
+            Access the inpainter to configure it before start(), or to read its results after wait().
+            Must not be accessed while running.
+        */
+        CriminisiInpainter &inpainter();
+
+        /**
+            Set an observer notified on the worker thread after the updates of each step are published.
+            Pass null (default) for none. Must not be changed while running.
+        */
+        void setObserver(ProgressObserver *observer);
+
+        /**
+            Initialize the inpainter and perform all steps on a background thread.
+
+            \param timeBudget Seconds available, see CriminisiInpainter::run. Negative (default) for no limit.
+        */
+        void start(double timeBudget = -1);
+
+        /** Request the worker to stop after the current step. */
+        void cancel();
+
+        /** Block until the worker has stopped. Rethrows errors raised by the inpainter. */
+        void wait();
+
+        /** True if the worker has stopped. Poll once more afterwards to receive the final updates. */
+        bool finished() const;
+
+        /** Fraction of target pixels filled so far, in [0, 1]. */
+        float progress() const;
+
+        /**
+            Apply updates published since the last poll.
+
+            \param image Snapshot of the inpainted image to update, initially the source image.
+            \param targetRegion Snapshot of the remaining target region to update, initially the target mask.
+            \param dirty Receives the modified regions, in the order they were inpainted.
+            \return true if any region was modified.
+        */
+        bool poll(cv::Mat &image, cv::Mat &targetRegion, std::vector<cv::Rect> &dirty);
+
+    private:
+
+        /** Copy of a region modified by a step. */
+        struct Update {
+            cv::Rect region;
+            cv::Mat image, targetRegion;
+            std::atomic<Update*> next;
+
+            Update();
+        };
+
+        class Worker;
+
+        /** Initialize and run the inpainter. Entry point of the worker thread. */
+        void work(double timeBudget);
+
+        /** Queue copies of the regions modified by the last step. Called by the worker. */
+        void publish();
+
+        /** Release all queued updates. */
+        void clear();
+
+        CriminisiInpainter _inpainter;
+        std::thread _thread;
+        std::exception_ptr _error;
+        std::vector<cv::Rect> _changed;
+        CancellationToken _cancel;
+        ProgressObserver *_observer;
+        std::atomic<bool> _finished;
+        std::atomic<float> _progress;
+
+        // Updates are linked from the consumed _head to the last published _tail.
+        Update *_head, *_tail;
+    };
+
+}
+#endif
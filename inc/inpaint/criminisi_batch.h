@@ -0,0 +1,82 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INPAINT_CRIMINISI_BATCH_H
+#define INPAINT_CRIMINISI_BATCH_H
+
+#include <inpaint/criminisi_inpainter.h>
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+namespace Inpaint {
+
+    /** A single image to be inpainted in place as part of a batch. */
+    struct InpaintingJob {
+        cv::Mat image;
+        cv::Mat targetMask;
+        cv::Mat sourceMask;
+        int patchSize;
+
+        /** Empty constructor */
+        InpaintingJob();
+
+        /** Initialize job. See inpaintCriminisi for parameters. */
+        InpaintingJob(cv::Mat image, cv::Mat targetMask, cv::Mat sourceMask, int patchSize);
+    };
+
+    /**
+        Inpaints batches of independent images on worker threads.
+
+        Jobs are grouped by image size, largest first, and ordered by estimated cost within a group. Workers
+        take the next job in this order as they become idle. Each worker keeps its CriminisiInpainter across
+        jobs and batches, so internal rasters are reallocated only when the image size changes. With jobs of
+        the same size next to each other, this is rare, but not guaranteed as workers interleave.
+    */
+    class CriminisiBatchInpainter {
+    public:
+
+        /** Empty constructor */
+        CriminisiBatchInpainter();
+
+        /** Set the number of workers. Zero (default) uses cv::getNumThreads(). */
+        void setWorkers(int n);
+
+        /** Inpaint all jobs. Images are modified in place. */
+        void run(std::vector<InpaintingJob> &jobs);
+
+    private:
+
+        class WorkerBody;
+
+        std::vector<CriminisiInpainter> _inpainters;
+        std::vector<int> _order;
+        int _nWorkers;
+    };
+
+    /**
+        Inpaint a batch of images concurrently.
+
+        This is a convinience method for using CriminisiBatchInpainter.
+
+        \param jobs Images to inpaint in place.
+    */
+    void inpaintCriminisiBatch(std::vector<InpaintingJob> &jobs);
+
+}
+#endif
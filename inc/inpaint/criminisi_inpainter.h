@@ -21,10 +21,64 @@
 #define INPAINT_CRIMINISI_INPAINTER_H
 
 #include <inpaint/template_match_candidates.h>
+#include <inpaint/indexed_heap.h>
+#include <inpaint/patch_distance.h>
+#include <inpaint/source_patch_index.h>
+#include <inpaint/patch_projections.h>
+#include <inpaint/spectral_distance.h>
+#include <inpaint/timer.h>
+#include <inpaint/progress.h>
 #include <opencv2/core/core.hpp>
+#include <vector>
+#include <utility>
 
 namespace Inpaint {
 
+    /** Timings and counts recorded by CriminisiInpainter when profiling is enabled. */
+    struct CriminisiStats {
+
+        /** Phases of inpainting. */
+        enum Phase {
+            /** Setup of rasters, the fill-front and search structures in initialize(). */
+            PHASE_INITIALIZE = 0,
+            /** Selection of the fill-front patches to inpaint. */
+            PHASE_TARGET_SELECTION,
+            /** TemplateMatchCandidates filtering, summed over all searches. Part of PHASE_SOURCE_SEARCH. */
+            PHASE_CANDIDATE_FILTER,
+            /** Search for source patches. */
+            PHASE_SOURCE_SEARCH,
+            /** Copying source patches and updating confidences. */
+            PHASE_PROPAGATION,
+            /** Updating the fill-front and its priorities. */
+            PHASE_FILL_FRONT,
+            PHASE_COUNT
+        };
+
+        /** Seconds spent in each phase. */
+        double seconds[PHASE_COUNT];
+
+        /** Number of times each phase ran. */
+        int64 calls[PHASE_COUNT];
+
+        /** Number of steps performed. */
+        int64 steps;
+
+        /** Number of patches inpainted. Exceeds steps when batching. */
+        int64 patches;
+
+        /** Number of source locations whose distance was evaluated or bounded. */
+        int64 candidatesTested;
+
+        /** Number of searches over all source locations after a restricted or filtered search found no match. */
+        int64 fallbackSearches;
+
+        /** Empty constructor */
+        CriminisiStats();
+
+        /** Accumulate the statistics of another run. */
+        void add(const CriminisiStats &other);
+    };
+
     /**
         Implementation of the exemplar based inpainting algorithm described in
         "Object Removal by Exemplar-Based Inpainting", A. Criminisi et. al.
@@ -37,17 +91,43 @@ namespace Inpaint {
             - the search for the best matching spot of the patch position to be inpainted
               is accelerated by TemplateMatchCandidates.
 
-        Please note edge cases (i.e regions on the image border) are crudely handled by simply
-        discarding them.
+        Internally all rasters are padded by the match window size. The padding is never compared
+        nor used as source, so regions touching the image border are inpainted as well.
 
       */
     class CriminisiInpainter {
     public:
 
+        /** Methods to search for source patches. */
+        enum SourceSearch {
+            /** Test all source locations passing the TemplateMatchCandidates filter. Exact. */
+            SOURCE_SEARCH_EXHAUSTIVE = 0,
+            /** Maintain a nearest neighbor field along the fill-front using PatchMatch. Approximate. */
+            SOURCE_SEARCH_PATCHMATCH = 1,
+            /** Query an index of all source patches built at initialization, re-ranking hits exactly. Approximate. */
+            SOURCE_SEARCH_INDEX = 2
+        };
+
+        /** Selection of frequency domain distance computation in exhaustive search. */
+        enum SpectralSearch {
+            /** Use when estimated to be faster than direct evaluation. */
+            SPECTRAL_SEARCH_AUTO = 0,
+            /** Always evaluate distances directly. */
+            SPECTRAL_SEARCH_NEVER = 1,
+            /** Always compute distances in the frequency domain. */
+            SPECTRAL_SEARCH_ALWAYS = 2
+        };
+
         /** Empty constructor */
         CriminisiInpainter();
 
-        /** Set the image to be inpainted. */
+        /**
+            Set the image to be inpainted. Images of 1 or 3 channels of 8-bit, 16-bit unsigned or 32-bit
+            floating point depth are supported. Patches are always copied at full precision. Matching
+            takes place on 8-bit and 16-bit values directly, floating point values are mapped linearly to
+            16-bit for matching. TemplateMatchCandidates, SourcePatchIndex, PatchProjections and
+            SpectralPatchDistance only apply to 8-bit images.
+        */
         void setSourceImage(const cv::Mat &bgrImage);
 
         /** Set the mask that describes the region inpainting can copy from. */
@@ -59,42 +139,337 @@ namespace Inpaint {
         /** Set the patch size. */
         void setPatchSize(int s);
 
-        /** Initialize inpainting. */
+        /** Half size of the window compared when matching patches of the given size. */
+        static int halfMatchSizeForPatchSize(int patchSize);
+
+        /** Set the norm used to compare patches. Either cv::NORM_L1 (default) or cv::NORM_L2SQR. */
+        void setNormType(int normType);
+
+        /**
+            Set the number of row bands the source search is split into. Bands are processed
+            concurrently on the OpenCV thread pool. Results do not depend on this setting.
+            Zero (default) uses cv::getNumThreads(), one searches serially. Small search windows are
+            always searched serially, and bands span at least 8 rows.
+        */
+        void setSearchThreads(int n);
+
+        /**
+            Set the number of resolution levels. With more than one level the image is first inpainted
+            at successively halved resolutions. On each finer level the source search for a target patch
+            is then restricted to a window around the upsampled match of the coarser level, falling back
+            to a full search if that window holds no valid source. Default is 1, i.e. single resolution.
+        */
+        void setPyramidLevels(int levels);
+
+        /** Set the radius of the search window around upsampled coarse matches. Default is 4. */
+        void setPyramidSearchRadius(int radius);
+
+        /**
+            Set the maximum number of patches filled per step. Each step takes fill-front locations in
+            order of priority, skipping those whose match window overlaps one already taken, and searches
+            their sources concurrently. Default is 1, which fills exactly the highest priority patch.
+        */
+        void setBatchSize(int k);
+
+        /**
+            Set the method used to search for source patches. See SourceSearch. Default is
+            SOURCE_SEARCH_EXHAUSTIVE.
+
+            SOURCE_SEARCH_PATCHMATCH keeps a nearest neighbor field for fill-front locations. Each
+            target is initialized from matches of neighboring front locations and from the sources its
+            already filled pixels were copied from, then refined by random search. The cost per step
+            does not depend on the image size.
+
+            SOURCE_SEARCH_INDEX builds a SourcePatchIndex over all valid source patches once and
+            re-ranks its approximate neighbors by exact distance. The cost per step grows sublinearly
+            with the number of source locations.
+        */
+        void setSourceSearch(int method);
+
+        /** Set the number of random search rounds per target when using SOURCE_SEARCH_PATCHMATCH. Default is 2. */
+        void setPatchMatchIterations(int iterations);
+
+        /**
+            Set the number of approximate neighbors re-ranked per target when using SOURCE_SEARCH_INDEX.
+            The index compares at most 32 times as many descriptors. Default is 16.
+        */
+        void setIndexNeighbors(int k);
+
+        /**
+            Enable rejecting source candidates by lower bounds computed from block sums. Block sums of all
+            source patches are precomputed at initialization, see PatchProjections. Results do not depend
+            on this setting. This needs 2 bytes per pixel, channel and block, i.e 54 bytes per pixel of a
+            color image for default patch sizes. Default is false.
+        */
+        void setProjectionPruning(bool enable);
+
+        /**
+            Set when exhaustive search computes distances to all source locations at once in the frequency
+            domain, see SpectralPatchDistance. Only applies to cv::NORM_L2SQR. Locations closest by the
+            transformed distances are verified directly, so results do not depend on this setting.
+            SPECTRAL_SEARCH_AUTO (default) considers match windows of 15 pixels and above, and picks
+            per search based on the number of source locations and the image size.
+        */
+        void setSpectralSearch(int mode);
+
+        /**
+            Set the radius of the initial window around a target that exhaustive search considers first.
+            If the best match in the window exceeds the error threshold, the radius is doubled until the
+            window covers the entire image. Zero (default) searches the entire image right away.
+        */
+        void setSearchRadius(int radius);
+
+        /**
+            Set the error up to which a match found in a search window is accepted, as mean error per
+            compared channel value in units of the norm used. Default is 10. Values of 16-bit and
+            floating point images are compared at 16-bit.
+        */
+        void setSearchErrorThreshold(float threshold);
+
+        /**
+            Set source offsets found for a previous, similar image, such as sourceOffsets() of the previous
+            frame of a video. Each target patch first evaluates the source its prior offset points to, which
+            tightens the bound for early termination and serves as a candidate for approximate searches.
+            Must be of type CV_32SC2 and image size, or empty (default) for no prior.
+        */
+        void setOffsetPrior(const cv::Mat &offsets);
+
+        /**
+            Set the radius of the window around the prior match to search first. The match found there is
+            accepted if its error is within setSearchErrorThreshold, otherwise the regular search follows.
+            Negative (default) does not restrict the search.
+        */
+        void setPriorSearchRadius(int radius);
+
+        /**
+            Enable quick search. Exhaustive search then takes the best match in a window around the
+            target, of setSearchRadius or else patch size radius, doubling the radius only while the
+            window holds no valid source. The cost per step then no longer depends on the image size,
+            at the expense of quality. Disabled by default.
+        */
+        void setQuickSearch(bool enable);
+
+        /**
+            Enable recording of per-phase timings and counts, see stats(). Disabled by default,
+            in which case initialize() and step() read no clocks.
+        */
+        void setProfiling(bool enable);
+
+        /**
+            Initialize inpainting.
+
+            Working buffers of previous calls are reused as long as the image size stays the same, so
+            repeated initialization for same sized images does not allocate. Note that this overwrites
+            the memory referenced by image(), targetRegion() and sourceOffsets() of the previous run.
+        */
         void initialize();
 
+        /**
+            Allocate working buffers for images of the given size and type in advance. Buffer sizes depend
+            on the patch size and projection pruning, so these should be set before.
+        */
+        void reserve(cv::Size size, int type = CV_8UC3);
+
+        /** Release all working buffers. Call initialize() before performing further steps. */
+        void shrink();
+
         /** True if there are more steps to perform. */
         bool hasMoreSteps();
 
-        /** Perform a single step (i.e fill one patch) and return the updated information. */
+        /**
+            Perform a single step (i.e fill one patch or one batch of patches) and return the updated information.
+            Throws a cv::Exception when no valid source patch exists for a target.
+        */
         void step();
 
+        /**
+            Perform steps until all target pixels are filled or cancellation is requested.
+
+            With a time budget, the time per filled pixel is tracked and the remaining steps switch to quick
+            search as soon as the remaining pixels at that rate would exceed the budget. The result is then
+            complete and usually on time, but steps already running are not interrupted.
+
+            \param timeBudget Seconds available. Negative (default) for no limit.
+            \param cancel Optional token checked before each step.
+            \param observer Optional observer notified after each step.
+            \return true if all target pixels have been filled.
+        */
+        bool run(double timeBudget = -1, const CancellationToken *cancel = 0, ProgressObserver *observer = 0);
+
+        /** Fraction of target pixels filled since initialize(), in [0, 1]. */
+        float progress() const;
+
+        /** Determine the regions of image() and targetRegion() modified by the last step. */
+        void changedRegions(std::vector<cv::Rect> &regions) const;
+
         /** Access the current state of the inpainted image. */
         cv::Mat image() const;
 
         /** Access the current state of the target region. */
         cv::Mat targetRegion() const;
+
+        /**
+            Access the offsets (source - target) from which inpainted pixels have been copied.
+            Pixels not inpainted so far have a zero offset.
+        */
+        cv::Mat sourceOffsets() const;
+
+        /** Access statistics recorded since the last initialize(). Only filled if profiling is enabled. */
+        CriminisiStats stats() const;
     private:
 
-        /** Updates the fill-front which is the border between filled and unfilled regions. */
-        void updateFillFront();
+        /**
+            Updates the fill-front, which is the border between filled and unfilled regions, and the
+            priorities of its pixels after the pixels in the given region changed.
+        */
+        void updateFillFront(const cv::Rect &changed);
 
         /** Find patch on fill front with highest priortiy. This will be the patch to be inpainted in this step. */
         cv::Point findTargetPatchLocation();
 
+        /** Find up to k fill-front patches of highest priority whose match windows do not overlap. */
+        void findTargetPatchLocations(int k, std::vector<cv::Point> &targets);
+
+        /** Calculate the priority for the given fill-front location having the given fill-front normal. */
+        float priorityForPatchLocation(cv::Point p, cv::Vec2f normal);
+
+        /** Best source location found by a scan. */
+        struct SourceMatch {
+            cv::Point location;
+            int64 error;
+            int tested;
+
+            SourceMatch();
+        };
+
+        /** Search state of a single target patch. */
+        struct SourceQuery {
+            MaskedPatchDistance distance;
+            cv::Mat candidates;
+            std::vector<SourceMatch> bandMatches;
+            PatchProjections::Template projection;
+            std::vector<cv::Point> tested, neighbors;
+            SpectralPatchDistance::Workspace spectralWorkspace;
+            SourcePatchIndex::Workspace indexWorkspace;
+            cv::Mat_<double> spectralDistances;
+            cv::RNG rng;
+            int64 candidatesTested, fallbacks;
+            double filterSeconds;
+            int64 filterCalls;
+
+            SourceQuery();
+        };
+
+        class SourceSearchBody;
+        class BatchSearchBody;
+
+        /** Inpaint lower resolution levels to guide the source search on this level. */
+        void initializeGuide();
+
+        /** Pad a field of offsets in image coordinates to the working rasters with zero offsets. Reuses the memory of padded when its size matches. */
+        void padField(const cv::Mat &offsets, cv::Mat_<cv::Vec2i> &padded) const;
+
+        /** Upsample offsets of a lower resolution level to the given size. */
+        static cv::Mat_<cv::Vec2i> upsampleOffsets(const cv::Mat_<cv::Vec2i> &offsets, cv::Size size);
+
+        /** Find the offset of the first pixel to be inpainted in the target patch that has a non-zero offset in the given field. */
+        bool findFieldOffset(const cv::Mat_<cv::Vec2i> &field, cv::Point targetPatchLocation, cv::Point &offset) const;
+
+        /** Maximum error of a match found in a restricted search to be accepted. */
+        double acceptableError(cv::Point targetPatchLocation) const;
+
+        /** Map a floating point image linearly to the 16-bit image used for matching. */
+        void mapToSearchImage();
+
+        /** True if the source region of the previous initialization can be reused. */
+        bool sourceRegionCached() const;
+
+        /** True if both masks are empty or have identical contents. */
+        static bool sameMask(const cv::Mat &a, const cv::Mat &b);
+
+        /** Determine the region of source locations suggested by the lower resolution level. */
+        bool findGuidedSearchRegion(cv::Point targetPatchLocation, cv::Rect &centers) const;
+
         /** For a given patch to inpaint, search for the best matching source patch to use for inpainting. */
-        cv::Point findSourcePatchLocation(cv::Point targetPatchLocation, bool useCandidateFilter);
+        cv::Point findSourcePatchLocation(SourceQuery &q, cv::Point targetPatchLocation, int nThreads);
+
+        /**
+            Search windows starting at the given radius around the target, doubling it until the best match is at most maxError.
+            Returns (-1,-1) if no window smaller than the given source locations yields a good enough match.
+        */
+        cv::Point searchLocalSourceRegion(SourceQuery &q, cv::Point targetPatchLocation, cv::Rect centers, int radius, double maxError, int nThreads);
+
+        /** Search for the best matching source patch among the given source locations, using nThreads row bands. */
+        SourceMatch searchSourceRegion(SourceQuery &q, cv::Point targetPatchLocation, cv::Rect centers, bool useCandidateFilter, int nThreads);
+
+        /** Search for a source patch by propagating and refining nearest neighbor field entries. */
+        cv::Point patchMatchSourceLocation(SourceQuery &q, cv::Point targetPatchLocation);
+
+        /** Search for a source patch among the approximate neighbors found by the source index. */
+        cv::Point indexSourceLocation(SourceQuery &q, cv::Point targetPatchLocation);
+
+        /** Evaluate the given source location unless invalid or already tested, and keep it if better. */
+        void testSourceCandidate(SourceQuery &q, cv::Point s, SourceMatch &best) const;
+
+        /** True if searching the given source locations in the frequency domain is estimated to be faster. */
+        bool useSpectralSearch(cv::Rect centers) const;
+
+        /** Scan the given region of source patch centers using frequency domain distances. Returns the first best match in scan order. */
+        SourceMatch spectralScanSourceRegion(SourceQuery &q, const cv::Mat &templ, const cv::Mat &mask, cv::Rect centers, bool useCandidateFilter) const;
+
+        /** Set the template of the given query. */
+        void setQueryTemplate(SourceQuery &q, const cv::Mat &templ, const cv::Mat &mask) const;
+
+        /** True if lower bounds can be used for the template of the given query. */
+        bool usesProjections(const SourceQuery &q) const;
+
+        /** True if the given source patch center passes the source region and the optional candidate filter. */
+        bool isSourceCandidate(const SourceQuery &q, cv::Point p, bool useCandidateFilter) const;
+
+        /**
+            Scan the given region of source patch centers. Returns the first best match in scan order.
+            Candidates with distance larger than bound are skipped early.
+        */
+        SourceMatch scanSourceRegion(const SourceQuery &q, cv::Rect centers, bool useCandidateFilter, int64 bound) const;
 
         /** Calculate the confidence for the given patch location. */
         float confidenceForPatchLocation(cv::Point p);
 
+        /** Update mean patch confidences for all patches overlapping the given region of changed confidences. */
+        void updatePatchConfidence(const cv::Rect &changed);
+
+        /** Variant of updatePatchConfidence for half patch size H, or the runtime one for H < 0. */
+        template<int H>
+        void updatePatchConfidence(const cv::Rect &changed);
+
         /** Given that we know the source and target patch, propagate associated values from the source into the target region. */
         void propagatePatch(cv::Point target, cv::Point source);
 
+        /** Variant of propagatePatch for half patch size H, or the runtime one for H < 0. */
+        template<int H>
+        void propagatePatch(cv::Point target, cv::Point source);
+
         struct UserSpecified {
             cv::Mat image;
             cv::Mat sourceMask;
             cv::Mat targetMask;
             int patchSize;
+            int normType;
+            int searchThreads;
+            int pyramidLevels;
+            int pyramidSearchRadius;
+            int batchSize;
+            int sourceSearch;
+            int patchMatchIterations;
+            int indexNeighbors;
+            bool projectionPruning;
+            int spectralSearch;
+            int searchRadius;
+            float searchErrorThreshold;
+            cv::Mat offsetPrior;
+            int priorSearchRadius;
+            bool profiling;
+            bool quickSearch;
 
             UserSpecified();
         };
@@ -102,11 +477,36 @@ namespace Inpaint {
         UserSpecified _input;
 
         TemplateMatchCandidates _tmc;
-        cv::Mat _image, _candidates;
-        cv::Mat_<uchar> _targetRegion, _borderRegion, _sourceRegion;
-        cv::Mat_<float> _isophoteX, _isophoteY, _confidence, _borderGradX, _borderGradY;
+        SourcePatchIndex _sourceIndex;
+        PatchProjections _projections;
+        SpectralPatchDistance _spectral;
+        IndexedMaxHeap _frontQueue;
+        cv::Mat _image, _searchImage;
+        cv::Mat_<uchar> _targetRegion, _knownRegion, _borderRegion, _sourceRegion;
+        cv::Mat_<float> _isophoteX, _isophoteY, _confidence, _patchConfidence;
+        cv::Mat _blurred;
+        cv::Mat _channelScratch;
+        cv::Mat _gradX, _gradY;
+        cv::Mat_<uchar> _scratchMask;
+        cv::Mat_<cv::Vec2i> _sourceOffsets, _guide, _nnf, _prior;
+        cv::Mat _cachedTargetMask, _cachedSourceMask;
+        int _cachedHalfMatchSize;
+        std::vector<cv::Point> _sourceCenters;
+        std::vector<double> _columnSums;
+        std::vector<SourceQuery> _queries;
+        std::vector<cv::Point> _batchTargets, _batchSources;
+        std::vector< std::pair<int, float> > _batchPopped;
+        std::vector<cv::Point> _frontBatch;
+        std::vector<float> _frontNormalsX, _frontNormalsY;
+        cv::Rect _interior;
         int _halfPatchSize, _halfMatchSize;
         int _startX, _startY, _endX, _endY;
+        int _remainingTargetPixels, _initialTargetPixels;
+        cv::Point _previousOffset;
+        bool _hasPreviousOffset;
+        bool _useCandidateFilter;
+        TimerWithStats _timer;
+        int64 _steps, _patches;
     };
 
     /**
@@ -120,12 +520,72 @@ namespace Inpaint {
         \param sourceMask Optional mask that specifies the region of the image to synthezise from. If left empty
                the entire image without the target mask is used.
         \param patchSize Patch size to use.
+        \param pyramidLevels Number of resolution levels to use. See CriminisiInpainter::setPyramidLevels.
+        \param contextMargin If non-negative, only the bounding boxes of connected target regions enlarged by this
+               margin are processed and used as source, see inpaintingRegionsOfInterest. Disjoint boxes are
+               inpainted concurrently on private copies, and only their target pixels are written back once
+               all boxes are done. The rest of the image is neither copied nor searched. If a source mask
+               allows no pixel within a box, the entire image is processed at once instead. If negative
+               (default), the entire image is processed at once.
+        \param stats If not null, profiling is enabled and the statistics of all regions are accumulated into it.
     */
     void inpaintCriminisi(
             cv::InputArray image,
             cv::InputArray targetMask,
             cv::InputArray sourceMask,
-            int patchSize);
+            int patchSize,
+            int pyramidLevels = 1,
+            int contextMargin = -1,
+            CriminisiStats *stats = 0);
+
+    /**
+        Inpaint image within a time budget.
+
+        See CriminisiInpainter::run for how the budget is kept.
+
+        \param image Image to be inpainted.
+        \param targetMask Region to be inpainted.
+        \param sourceMask Optional mask that specifies the region of the image to synthezise from.
+        \param patchSize Patch size to use.
+        \param timeBudget Seconds available. Negative for no limit.
+        \param cancel Optional token to stop inpainting early. The image then holds the partial result.
+        \param observer Optional observer notified of progress.
+        \return true if all target pixels have been filled.
+    */
+    bool inpaintCriminisiBudgeted(
+            cv::InputArray image,
+            cv::InputArray targetMask,
+            cv::InputArray sourceMask,
+            int patchSize,
+            double timeBudget,
+            const CancellationToken *cancel = 0,
+            ProgressObserver *observer = 0);
+
+    /**
+        Determine the region of an image inpainting needs to process.
+
+        \param targetMask Region to be inpainted.
+        \param contextMargin Number of pixels around the target region to search for source patches.
+        \param patchSize Patch size to use.
+        \return Bounding box of the target region enlarged by margin and match window size, clipped to the image.
+                The window size ensures known pixels for at least one source patch next to the target, so
+                any non-negative margin can be used.
+                Empty if there is nothing to inpaint.
+    */
+    cv::Rect inpaintingRegionOfInterest(cv::InputArray targetMask, int contextMargin, int patchSize);
+
+    /**
+        Determine independent regions of an image inpainting needs to process.
+
+        Each connected component of the target mask is enlarged as in inpaintingRegionOfInterest.
+        Overlapping regions are merged until all are disjoint.
+
+        \param targetMask Region to be inpainted.
+        \param contextMargin Number of pixels around each target component to search for source patches.
+        \param patchSize Patch size to use.
+        \param regions Disjoint regions, each containing entire target components.
+    */
+    void inpaintingRegionsOfInterest(cv::InputArray targetMask, int contextMargin, int patchSize, std::vector<cv::Rect> &regions);
 
 }
 #endif
@@ -0,0 +1,71 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef INPAINT_CRIMINISI_VIDEO_H
+#define INPAINT_CRIMINISI_VIDEO_H
+
+#include <inpaint/criminisi_inpainter.h>
+#include <opencv2/core/core.hpp>
+
+namespace Inpaint {
+
+    /**
+        Inpaints consecutive frames of a video, carrying state from one frame to the next.
+
+        The source offsets of the previous frame serve as prior for the current one. They are tried first
+        for each target patch and, if set, restrict the search to a window around the previous match.
+        The inpainter is kept across frames, so its buffers and the source region derived from the masks
+        are reused while the frame size and masks stay the same.
+    */
+    class CriminisiVideoInpainter {
+    public:
+
+        /** Empty constructor */
+        CriminisiVideoInpainter();
+
+        /** Access the inpainter to configure patch size, search strategy and the like. */
+        CriminisiInpainter &inpainter();
+
+        /**
+            Set the radius of the window around the match of the previous frame to search first.
+            Negative (default) only uses the previous match as first candidate. See CriminisiInpainter::setPriorSearchRadius.
+        */
+        void setSearchRadius(int radius);
+
+        /**
+            Inpaint the next frame in place.
+
+            \param frame Frame of 1 or 3 channels, 8-bit, 16-bit or floating point. See CriminisiInpainter::setSourceImage.
+            \param targetMask Region to inpaint. See CriminisiInpainter::setTargetMask.
+            \param sourceMask Optional region to copy from. See CriminisiInpainter::setSourceMask.
+        */
+        void process(cv::Mat &frame, const cv::Mat &targetMask, const cv::Mat &sourceMask = cv::Mat());
+
+        /** Forget the previous frame, for example at a scene cut. */
+        void reset();
+
+    private:
+        CriminisiInpainter _inpainter;
+        cv::Mat _previousOffsets;
+        int _searchRadius;
+    };
+
+}
+#endif
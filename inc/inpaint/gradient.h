@@ -80,6 +80,37 @@ namespace Inpaint {
         return grad;
     }
 
+    /**
+        Compute normalized gradients for a batch of points.
+
+        Same as calling normalizedGradient for each point, but the normalization runs
+        as a separate pass over contiguous arrays so that it can be vectorized by the
+        compiler. No bounds checking is done and it assumes single channel images.
+
+        \param m Image to operate on.
+        \param points Points to compute gradients for.
+        \param n Number of points.
+        \param gx Output x-components of normalized gradients. Needs to hold n elements.
+        \param gy Output y-components of normalized gradients. Needs to hold n elements.
+
+     */
+    template<class Mat>
+    void normalizedGradients(const Mat &m, const cv::Point *points, int n, float *gx, float *gy)
+    {
+        for (int i = 0; i < n; ++i) {
+            const cv::Vec2f grad = gradient(m, points[i].y, points[i].x);
+            gx[i] = grad[0];
+            gy[i] = grad[1];
+        }
+
+        for (int i = 0; i < n; ++i) {
+            const float dot = gx[i] * gx[i] + gy[i] * gy[i];
+            const float len = sqrtf(dot);
+            gx[i] = (dot == 0) ? 0.f : gx[i] / len;
+            gy[i] = (dot == 0) ? 0.f : gy[i] / len;
+        }
+    }
+
 
 }
 #endif
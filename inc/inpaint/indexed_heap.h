@@ -0,0 +1,196 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INPAINT_INDEXED_HEAP_H
+#define INPAINT_INDEXED_HEAP_H
+
+#include <vector>
+#include <utility>
+#include <cassert>
+
+namespace Inpaint {
+
+    /**
+        Binary max-heap over integer keys in the range [0, capacity) that supports
+        changing and removing the priority of arbitrary keys in O(log n).
+
+        Ties are broken in favor of the smaller key, so the top element is the same one
+        a linear scan over keys in ascending order using a strict greater-than would find.
+    */
+    class IndexedMaxHeap {
+    public:
+
+        /** Remove all elements and prepare for keys in the range [0, capacity). */
+        inline void reset(int capacity)
+        {
+            _heap.clear();
+            _positions.assign(capacity, -1);
+        }
+
+        /** Allocate memory for keys in the range [0, capacity) without changing the heap. */
+        inline void reserve(int capacity)
+        {
+            _heap.reserve(capacity);
+            if (static_cast<int>(_positions.size()) < capacity)
+                _positions.resize(capacity, -1);
+        }
+
+        /** True if the heap has no elements. */
+        inline bool empty() const
+        {
+            return _heap.empty();
+        }
+
+        /** Number of elements in heap. */
+        inline int size() const
+        {
+            return static_cast<int>(_heap.size());
+        }
+
+        /** True if the given key is in the heap. */
+        inline bool contains(int key) const
+        {
+            return _positions[key] != -1;
+        }
+
+        /** Key with the highest priority. */
+        inline int top() const
+        {
+            assert(!_heap.empty());
+            return _heap.front().key;
+        }
+
+        /** Highest priority. */
+        inline float topPriority() const
+        {
+            assert(!_heap.empty());
+            return _heap.front().priority;
+        }
+
+        /** Insert key or change its priority if already present. */
+        inline void push(int key, float priority)
+        {
+            int pos = _positions[key];
+            if (pos == -1) {
+                pos = static_cast<int>(_heap.size());
+                _heap.push_back(Node(key, priority));
+                _positions[key] = pos;
+                siftUp(pos);
+            } else {
+                const bool increased = before(Node(key, priority), _heap[pos]);
+                _heap[pos].priority = priority;
+                if (increased) {
+                    siftUp(pos);
+                } else {
+                    siftDown(pos);
+                }
+            }
+        }
+
+        /** Remove key from heap. Does nothing if key is not present. */
+        inline void remove(int key)
+        {
+            const int pos = _positions[key];
+            if (pos == -1)
+                return;
+
+            const int last = static_cast<int>(_heap.size()) - 1;
+            _positions[key] = -1;
+
+            if (pos != last) {
+                // Move last element into the gap and restore heap order around it.
+                const int movedKey = _heap[last].key;
+                _heap[pos] = _heap[last];
+                _positions[movedKey] = pos;
+                _heap.pop_back();
+
+                siftUp(pos);
+                siftDown(_positions[movedKey]);
+            } else {
+                _heap.pop_back();
+            }
+        }
+
+        /** Remove the element with the highest priority. */
+        inline void pop()
+        {
+            remove(top());
+        }
+
+    private:
+
+        struct Node {
+            int key;
+            float priority;
+
+            Node(int k, float p)
+                : key(k), priority(p)
+            {}
+        };
+
+        /** True if a should be closer to the top than b. */
+        static inline bool before(const Node &a, const Node &b)
+        {
+            return a.priority > b.priority || (a.priority == b.priority && a.key < b.key);
+        }
+
+        inline void swapNodes(int i, int j)
+        {
+            std::swap(_heap[i], _heap[j]);
+            _positions[_heap[i].key] = i;
+            _positions[_heap[j].key] = j;
+        }
+
+        inline void siftUp(int i)
+        {
+            while (i > 0) {
+                const int parent = (i - 1) / 2;
+                if (!before(_heap[i], _heap[parent]))
+                    break;
+                swapNodes(i, parent);
+                i = parent;
+            }
+        }
+
+        inline void siftDown(int i)
+        {
+            const int n = static_cast<int>(_heap.size());
+            for (;;) {
+                const int l = 2 * i + 1;
+                const int r = l + 1;
+                int best = i;
+
+                if (l < n && before(_heap[l], _heap[best]))
+                    best = l;
+                if (r < n && before(_heap[r], _heap[best]))
+                    best = r;
+                if (best == i)
+                    break;
+
+                swapNodes(i, best);
+                i = best;
+            }
+        }
+
+        std::vector<Node> _heap;
+        std::vector<int> _positions;
+    };
+
+}
+#endif
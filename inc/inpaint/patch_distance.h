@@ -0,0 +1,119 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INPAINT_PATCH_DISTANCE_H
+#define INPAINT_PATCH_DISTANCE_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <limits>
+
+namespace Inpaint {
+
+    /**
+        Masked distance between a fixed template and patches of an 8-bit or 16-bit image.
+
+        The template and its mask are copied into aligned row buffers once. Each
+        evaluation then only reads raw row pointers of the candidate patch. Inner loops
+        for 8-bit images use AVX2 or SSE2 when available and fall back to scalar code otherwise.
+        Those for 16-bit images accumulate in 64-bit integers and are left to the compiler to vectorize.
+        Square 8-bit templates of 1 or 3 channels and sides 5 to 13 use kernels whose row count and
+        row length are fixed at compile time.
+
+        Results are identical to cv::norm(templ, patch, normType, mask) for
+        cv::NORM_L1 and cv::NORM_L2SQR.
+    */
+    class MaskedPatchDistance {
+    public:
+
+        /** Empty constructor */
+        MaskedPatchDistance();
+
+        /** Set the norm to use. Either cv::NORM_L1 or cv::NORM_L2SQR. */
+        void setNormType(int normType);
+
+        /** Enable or disable kernels specialized for common template sizes. Enabled by default. */
+        void setFixedSizeKernels(bool enable);
+
+        /**
+            Set the template to compare against.
+
+            \param templ 8-bit or 16-bit unsigned template of 1 or 3 channels.
+            \param mask 8-bit single channel mask of same size. Only non-zero positions
+                   are compared. If empty, all positions are compared.
+        */
+        void setTemplate(const cv::Mat &templ, const cv::Mat &mask);
+
+        /**
+            Compute distance to the patch of the template size anchored top-left at the given pointer.
+
+            \param patch Pointer to the top-left element of the patch. Needs to be of the same type as the template.
+            \param step Row step of the image in bytes.
+            \return distance
+        */
+        inline int64 operator()(const uchar *patch, size_t step) const
+        {
+            return (*this)(patch, step, std::numeric_limits<int64>::max());
+        }
+
+        /**
+            Compute distance with early termination.
+
+            The distance is accumulated row by row. As soon as the partial sum exceeds the given
+            bound, evaluation stops and the partial sum is returned.
+
+            \param patch Pointer to the top-left element of the patch.
+            \param step Row step of the image in bytes.
+            \param bound Upper bound of interest.
+            \return distance if it is less than or equal to bound, otherwise a value larger than bound.
+        */
+        inline int64 operator()(const uchar *patch, size_t step, int64 bound) const
+        {
+            return _kernel(_templ.empty() ? 0 : &_templ[0], _mask.empty() ? 0 : &_mask[0], patch, step, _rows, _rowStride, _rowElements, bound);
+        }
+
+        /** Compute distance to the patch of the given image anchored top-left at the given position. */
+        inline int64 operator()(const cv::Mat &image, int y, int x) const
+        {
+            return (*this)(image.ptr<uchar>(y, x), image.step);
+        }
+
+        /** Compute distance with early termination to the patch of the given image anchored top-left at the given position. */
+        inline int64 operator()(const cv::Mat &image, int y, int x, int64 bound) const
+        {
+            return (*this)(image.ptr<uchar>(y, x), image.step, bound);
+        }
+
+        /** Signature of kernels accumulating the distance over all rows. */
+        typedef int64 (*Kernel)(const uchar *templ, const uchar *mask, const uchar *patch, size_t step, int rows, int rowStride, int rowElements, int64 bound);
+
+    private:
+        /** Select the kernel for the current template, norm and depth. */
+        void selectKernel();
+
+        std::vector<uchar> _templ, _mask;
+        int _rows, _rowElements, _rowStride;
+        int _normType;
+        int _depth;
+        bool _fixedSizeKernels;
+        Kernel _kernel;
+    };
+
+}
+#endif
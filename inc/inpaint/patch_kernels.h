@@ -0,0 +1,121 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INPAINT_PATCH_KERNELS_H
+#define INPAINT_PATCH_KERNELS_H
+
+#include <opencv2/core/core.hpp>
+
+namespace Inpaint {
+
+    /**
+        Kernels operating on the masked elements of square patches.
+
+        The half patch size is a template parameter H. For H >= 0 patch loops have a compile time
+        trip count and are unrolled by the compiler. For H < 0 the halfPatchSize argument is used
+        instead, which is the generic variant for arbitrary patch sizes. Callers dispatch on the
+        common sizes and fall back to H = -1 otherwise.
+
+        Patches are unchecked and need to lie within the images. The mask is a single channel 8-bit
+        image of the same geometry as the destination and is read at the destination patch.
+    */
+
+    /** Raw element of the given number of bytes. Copies compile to plain moves. */
+    template<int Bytes>
+    struct PatchElement {
+        uchar b[Bytes];
+    };
+
+    /** Copy elements of type T from the source patch to the destination patch where the mask is non-zero. */
+    template<int H, class T>
+    inline void copyMaskedPatch(const cv::Mat &src, cv::Point s, cv::Mat &dst, cv::Point t, const cv::Mat &mask, int halfPatchSize)
+    {
+        const int h = H >= 0 ? H : halfPatchSize;
+        const int n = 2 * h + 1;
+
+        for (int y = 0; y < n; ++y) {
+            const T *sRow = src.ptr<T>(s.y - h + y) + (s.x - h);
+            T *dRow = dst.ptr<T>(t.y - h + y) + (t.x - h);
+            const uchar *mRow = mask.ptr<uchar>(t.y - h + y) + (t.x - h);
+            for (int x = 0; x < n; ++x) {
+                if (mRow[x])
+                    dRow[x] = sRow[x];
+            }
+        }
+    }
+
+    /** Copy masked elements of a patch for images of any type. */
+    template<int H>
+    inline void copyMaskedPatch(const cv::Mat &src, cv::Point s, cv::Mat &dst, cv::Point t, const cv::Mat &mask, int halfPatchSize)
+    {
+        CV_Assert(src.type() == dst.type());
+
+        switch (src.elemSize()) {
+        case 1: copyMaskedPatch<H, PatchElement<1> >(src, s, dst, t, mask, halfPatchSize); break;
+        case 2: copyMaskedPatch<H, PatchElement<2> >(src, s, dst, t, mask, halfPatchSize); break;
+        case 3: copyMaskedPatch<H, PatchElement<3> >(src, s, dst, t, mask, halfPatchSize); break;
+        case 4: copyMaskedPatch<H, PatchElement<4> >(src, s, dst, t, mask, halfPatchSize); break;
+        case 6: copyMaskedPatch<H, PatchElement<6> >(src, s, dst, t, mask, halfPatchSize); break;
+        case 8: copyMaskedPatch<H, PatchElement<8> >(src, s, dst, t, mask, halfPatchSize); break;
+        case 12: copyMaskedPatch<H, PatchElement<12> >(src, s, dst, t, mask, halfPatchSize); break;
+        default: {
+            const int h = H >= 0 ? H : halfPatchSize;
+            cv::Mat d = dst(cv::Rect(t.x - h, t.y - h, 2 * h + 1, 2 * h + 1));
+            src(cv::Rect(s.x - h, s.y - h, 2 * h + 1, 2 * h + 1)).copyTo(d, mask(cv::Rect(t.x - h, t.y - h, 2 * h + 1, 2 * h + 1)));
+        }
+        }
+    }
+
+    /** Set elements of type T in the destination patch to the given value where the mask is non-zero. */
+    template<int H, class T>
+    inline void fillMaskedPatch(cv::Mat &dst, cv::Point t, const cv::Mat &mask, const T &value, int halfPatchSize)
+    {
+        const int h = H >= 0 ? H : halfPatchSize;
+        const int n = 2 * h + 1;
+
+        for (int y = 0; y < n; ++y) {
+            T *dRow = dst.ptr<T>(t.y - h + y) + (t.x - h);
+            const uchar *mRow = mask.ptr<uchar>(t.y - h + y) + (t.x - h);
+            for (int x = 0; x < n; ++x) {
+                if (mRow[x])
+                    dRow[x] = value;
+            }
+        }
+    }
+
+    /** Clear the mask within the patch. Returns the number of elements that were non-zero. */
+    template<int H>
+    inline int clearMaskedPatch(cv::Mat &mask, cv::Point t, int halfPatchSize)
+    {
+        const int h = H >= 0 ? H : halfPatchSize;
+        const int n = 2 * h + 1;
+
+        int count = 0;
+        for (int y = 0; y < n; ++y) {
+            uchar *mRow = mask.ptr<uchar>(t.y - h + y) + (t.x - h);
+            for (int x = 0; x < n; ++x) {
+                count += mRow[x] != 0;
+                mRow[x] = 0;
+            }
+        }
+        return count;
+    }
+
+}
+#endif
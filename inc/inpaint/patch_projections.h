@@ -0,0 +1,130 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INPAINT_PATCH_PROJECTIONS_H
+#define INPAINT_PATCH_PROJECTIONS_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <cstdlib>
+
+namespace Inpaint {
+
+    /**
+        Lower bounds of masked patch distances from low-dimensional patch projections.
+
+        A patch is projected onto the sums of a grid of blocks per channel, i.e the lowest order
+        Walsh-Hadamard coefficient of each block. Projections are precomputed for all positions of
+        an image once. Sums are stored as 16-bit values, so blocks are made small enough to hold at
+        most 257 pixels by using more partitions for large patches.
+
+        For a block entirely known in the template, the triangle inequality gives
+        sum |t - s| >= |sum t - sum s| and Cauchy-Schwarz gives sum (t - s)^2 >= (sum t - sum s)^2 / n.
+        Summing these over all known blocks bounds cv::NORM_L1 and cv::NORM_L2SQR distances from
+        below, so candidates whose bound exceeds the best distance found so far can be rejected
+        without reading their pixels. Unlike TemplateMatchCandidates this never rejects a candidate
+        that could be the best match.
+    */
+    class PatchProjections {
+    public:
+
+        /** Projection of a partially known template. */
+        struct Template {
+            std::vector<int> blocks;    // Indices of blocks entirely known
+            std::vector<int> sums;      // Template sums of known blocks, per channel
+            int normType;
+        };
+
+        /** Empty constructor */
+        PatchProjections();
+
+        /** Set the number of blocks in x and y direction per patch. Default is 3. Clamped to the patch size. */
+        void setPartitionSize(int n);
+
+        /**
+            Precompute projections.
+
+            \param image 8-bit image of 1 or 3 channels.
+            \param mask Projections are computed for patches centered at non-zero positions only.
+            \param halfPatchSize Half size of patches. Patches at non-zero mask positions need to be inside the image.
+        */
+        void build(const cv::Mat &image, const cv::Mat &mask, int halfPatchSize);
+
+        /** Allocate memory for building projections of images of the given size, channels and half patch size. */
+        void reserve(cv::Size size, int channels, int halfPatchSize);
+
+        /** True if no projections were built. */
+        bool empty() const;
+
+        /** Remove projections. Memory is kept for subsequent builds. */
+        void clear();
+
+        /**
+            Project a template.
+
+            \param templ Template of patch size and image type.
+            \param templMask 8-bit single channel mask of known template pixels.
+            \param normType Either cv::NORM_L1 or cv::NORM_L2SQR.
+            \param t Projected template.
+        */
+        void project(const cv::Mat &templ, const cv::Mat &templMask, int normType, Template &t) const;
+
+        /** Lower bound of the masked distance between template and the patch centered at the given position. */
+        inline int64 lowerBound(const Template &t, int y, int x) const
+        {
+            const ushort *s = &_sums[(static_cast<size_t>(y) * _cols + x) * _dims];
+            const int nBlocks = static_cast<int>(t.blocks.size());
+
+            int64 bound = 0;
+            if (t.normType == cv::NORM_L1) {
+                for (int i = 0; i < nBlocks; ++i) {
+                    const ushort *sb = s + t.blocks[i] * _channels;
+                    const int *tb = &t.sums[i * _channels];
+                    for (int c = 0; c < _channels; ++c)
+                        bound += std::abs(tb[c] - int(sb[c]));
+                }
+            } else {
+                for (int i = 0; i < nBlocks; ++i) {
+                    const ushort *sb = s + t.blocks[i] * _channels;
+                    const int *tb = &t.sums[i * _channels];
+                    const int64 area = _areas[t.blocks[i]];
+                    for (int c = 0; c < _channels; ++c) {
+                        const int64 d = tb[c] - int(sb[c]);
+                        bound += (d * d) / area;
+                    }
+                }
+            }
+
+            return bound;
+        }
+
+    private:
+        /** Number of blocks in x and y direction used for patches of the given size. */
+        int partitionsForSize(int size) const;
+
+        std::vector<cv::Rect> _blocks;
+        std::vector<int> _areas;
+        std::vector<ushort> _sums;
+        cv::Mat _integral;
+        int _cols, _channels, _dims;
+        int _partitions, _halfPatchSize;
+    };
+
+}
+#endif
@@ -0,0 +1,73 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef INPAINT_PROGRESS_H
+#define INPAINT_PROGRESS_H
+
+#include <atomic>
+
+namespace Inpaint {
+
+    /**
+        Flag to request cancellation of a running inpainting from another thread.
+    */
+    class CancellationToken {
+    public:
+
+        /** Empty constructor */
+        inline CancellationToken()
+            : _cancelled(false)
+        {}
+
+        /** Request cancellation. */
+        inline void cancel()
+        {
+            _cancelled.store(true);
+        }
+
+        /** Clear a previous request, so the token can be used again. */
+        inline void reset()
+        {
+            _cancelled.store(false);
+        }
+
+        /** True if cancellation has been requested. */
+        inline bool cancelled() const
+        {
+            return _cancelled.load();
+        }
+
+    private:
+        std::atomic<bool> _cancelled;
+    };
+
+    /**
+        Receives progress of a running inpainting. Called on the thread performing it.
+    */
+    class ProgressObserver {
+    public:
+        virtual ~ProgressObserver() {}
+
+        /** Called after each step with the fraction of target pixels filled so far, in [0, 1]. */
+        virtual void progress(float fraction) = 0;
+    };
+
+}
+#endif
@@ -27,9 +27,12 @@ namespace Inpaint {
     /**
         Compute a sequence of lower resolution images.
 
-        \param i Integral image
-        \param r Rectangle to compute sum for
-        \return sum as scalar.
+        Each level halves the resolution of the previous one. The first level is a copy of the input.
+
+        \param image Input image
+        \param pyr Output levels, finest first
+        \param minimumSize Levels are added as long as the new level is at least this size.
+        \param interpolationType Interpolation passed to cv::resize
     */
     void imagePyramid(cv::InputArray image, cv::OutputArrayOfArrays pyr, cv::Size minimumSize, int interpolationType);
 
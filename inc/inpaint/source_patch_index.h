@@ -0,0 +1,119 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INPAINT_SOURCE_PATCH_INDEX_H
+#define INPAINT_SOURCE_PATCH_INDEX_H
+
+#include <opencv2/core/core.hpp>
+#include <utility>
+#include <vector>
+
+namespace Inpaint {
+
+    /**
+        Approximate nearest neighbor index over a fixed set of image patches.
+
+        Each patch is described by the per channel means of a grid of blocks, rounded to 8 bits. The
+        descriptors are organized in a forest of randomized kd-trees, which is searched best-bin-first up to a
+        maximum number of descriptor comparisons.
+
+        Queries may be partially known. Blocks not entirely covered by the query mask are ignored,
+        both when comparing descriptors and when descending trees. Tree splits on ignored dimensions
+        visit both children.
+
+        Results are candidates only. Callers are expected to re-rank them with an exact patch distance.
+    */
+    class SourcePatchIndex {
+    public:
+
+        /** Branch of a tree still to visit, as (distance bound, (tree, node)). */
+        typedef std::pair<float, std::pair<int, int> > Branch;
+
+        /** Temporary buffers of a single query. */
+        struct Workspace {
+            std::vector<float> query;
+            std::vector<uchar> valid;
+            std::vector<Branch> branches;
+            std::vector< std::pair<float, int> > best;
+            std::vector<unsigned> seen;  // Stamp of the last query that compared each patch
+            unsigned stamp;
+
+            Workspace();
+        };
+
+        /** Empty constructor */
+        SourcePatchIndex();
+
+        /** Set the number of randomized trees. Default is 4. */
+        void setTrees(int n);
+
+        /** Set the number of blocks in x and y direction per patch. Default is 4. Clamped to the patch size. */
+        void setPartitionSize(int n);
+
+        /**
+            Build the index.
+
+            \param image 8-bit image of 1 or 3 channels. Must stay unchanged in the regions of indexed patches.
+            \param centers Centers of the patches to index.
+            \param halfPatchSize Half size of the indexed patches.
+        */
+        void build(const cv::Mat &image, const std::vector<cv::Point> &centers, int halfPatchSize);
+
+        /** True if no patches are indexed. */
+        bool empty() const;
+
+        /**
+            Find approximate nearest neighbors of a partially known patch.
+
+            \param templ Patch of the indexed size and image type.
+            \param templMask 8-bit single channel mask of known template pixels.
+            \param k Number of neighbors to return.
+            \param maxChecks Maximum number of descriptor comparisons.
+            \param neighbors Centers of found patches, closest first.
+            \param ws Buffers to use.
+            \return false if the mask leaves no block to compare, in which case neighbors is empty.
+        */
+        bool query(const cv::Mat &templ, const cv::Mat &templMask, int k, int maxChecks, std::vector<cv::Point> &neighbors, Workspace &ws) const;
+
+    private:
+
+        struct Node {
+            int dim;        // Split dimension, -1 for leaves
+            float split;
+            int left, right; // Children for inner nodes, index range for leaves
+        };
+
+        /** Recursively split the given range of a tree's indices. Returns the node index. */
+        int buildNode(std::vector<Node> &nodes, std::vector<int> &indices, int begin, int end, cv::RNG &rng);
+
+        /** Squared distance of descriptor i to the query over valid dimensions. */
+        float distance(int i, const Workspace &ws) const;
+
+        std::vector<cv::Rect> _blocks;
+        std::vector<cv::Point> _centers;
+        std::vector<uchar> _descriptors;
+        std::vector< std::vector<Node> > _trees;
+        std::vector< std::vector<int> > _treeIndices;
+        int _dims, _channels;
+        int _nTrees, _partitions;
+        int _halfPatchSize;
+    };
+
+}
+#endif
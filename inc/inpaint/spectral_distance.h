@@ -0,0 +1,89 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INPAINT_SPECTRAL_DISTANCE_H
+#define INPAINT_SPECTRAL_DISTANCE_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+namespace Inpaint {
+
+    /**
+        Masked sum of squared differences between a template and all patches of an image at once.
+
+        With mask m, template t and image s the distance at position x expands into
+        sum m*t^2 - 2 * sum m*t*s(x) + sum m*s(x)^2. The last two terms are correlations of the image
+        and of its squares with m*t and m, which are evaluated by multiplication in the frequency domain.
+        Spectra of the image are computed once, so each template costs four forward and one inverse
+        transform of image size, independent of the template size.
+
+        Values carry the rounding error of the transforms. Callers requiring exact results should
+        verify the smallest values with MaskedPatchDistance.
+    */
+    class SpectralPatchDistance {
+    public:
+
+        /** Temporary buffers of a single computation. */
+        struct Workspace {
+            cv::Mat kernel, kernelSpectrum, product, accum;
+        };
+
+        /** Empty constructor */
+        SpectralPatchDistance();
+
+        /**
+            Set the image to compare against and precompute its spectra.
+
+            \param image 8-bit image of 1 or 3 channels. Patches whose values are read later on need to stay unchanged.
+            \param templSize Size of templates.
+        */
+        void setImage(const cv::Mat &image, cv::Size templSize);
+
+        /** True if no image was set. */
+        bool empty() const;
+
+        /** Remove image. Memory is kept for subsequent images. */
+        void clear();
+
+        /** Size of the transforms used. */
+        cv::Size transformSize() const;
+
+        /**
+            Compute masked squared distances for all positions.
+
+            \param templ Template of image type and set size.
+            \param mask 8-bit single channel mask of template. Only non-zero positions are compared.
+            \param distances Distance of template anchored top-left at (x,y) for every position where it fits
+                   into the image. Of size (W - w + 1, H - h + 1).
+            \param ws Buffers to use.
+        */
+        void compute(const cv::Mat &templ, const cv::Mat &mask, cv::Mat_<double> &distances, Workspace &ws) const;
+
+    private:
+        std::vector<cv::Mat> _spectra;  // Spectra of image channels followed by the spectrum of summed squares
+        cv::Size _imageSize, _templSize, _dftSize;
+        std::vector<cv::Mat> _channelPlanes;
+        cv::Mat _padded, _squares;
+        int _channels;
+        bool _ready;
+    };
+
+}
+#endif
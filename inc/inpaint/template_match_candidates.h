@@ -66,6 +66,9 @@ namespace Inpaint {
         /** Initialize candidate search. */
         void initialize();
 
+        /** Allocate integral images for source images of the given size and channel count in advance. */
+        void reserve(cv::Size imageSize, int channels);
+
         /**
             Find candidates.
 
@@ -115,6 +118,7 @@ namespace Inpaint {
                 float maxMeanDiff, int maxWeakErrors);
 
         cv::Mat _image;
+        std::vector< cv::Mat_<uchar> > _imageChannels;
         std::vector< cv::Mat_<int> > _integrals;
         std::vector< cv::Rect > _blocks;
         cv::Size _templateSize;
@@ -46,6 +46,10 @@ namespace Inpaint {
         double _invFreq;
     };
 
+    /**
+        Timer accumulating elapsed times of up to ten indexed phases. Each call to measure
+        attributes the time since the previous call to the given phase.
+    */
     class TimerWithStats {
     public:
 
@@ -55,6 +59,38 @@ namespace Inpaint {
             _stats[index].called += 1;
         }
 
+        /** Discard the time elapsed since the previous measurement. */
+        inline void restart()
+        {
+            _t.measure();
+        }
+
+        /** Account for time measured elsewhere, for example by other threads. */
+        inline void add(int index, double seconds, int64 called)
+        {
+            _stats[index].sum += seconds;
+            _stats[index].called += called;
+        }
+
+        /** Clear all statistics without reading the clock. */
+        inline void clear()
+        {
+            for (int i = 0; i < 10; ++i)
+                _stats[i] = Stats();
+        }
+
+        /** Clear all statistics and restart. */
+        inline void reset()
+        {
+            clear();
+            _t.measure();
+        }
+
+        inline int64 called(int index) const
+        {
+            return _stats[index].called;
+        }
+
         inline double mean(int index) const
         {
             return _stats[index].sum / _stats[index].called;
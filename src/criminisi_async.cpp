@@ -0,0 +1,179 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <inpaint/criminisi_async.h>
+#include <opencv2/opencv.hpp>
+
+namespace Inpaint {
+
+    CriminisiAsyncInpainter::Update::Update()
+        : next(0)
+    {}
+
+    /** Publishes updates whenever the inpainter reports progress. */
+    class CriminisiAsyncInpainter::Worker : public ProgressObserver {
+    public:
+        Worker(CriminisiAsyncInpainter &a)
+            : _a(a)
+        {}
+
+        void progress(float fraction)
+        {
+            _a.publish();
+            _a._progress.store(fraction);
+            if (_a._observer)
+                _a._observer->progress(fraction);
+        }
+
+    private:
+        CriminisiAsyncInpainter &_a;
+    };
+
+    CriminisiAsyncInpainter::CriminisiAsyncInpainter()
+        : _observer(0), _finished(true), _progress(0.f)
+    {
+        _head = _tail = new Update();
+    }
+
+    CriminisiAsyncInpainter::~CriminisiAsyncInpainter()
+    {
+        _cancel.cancel();
+        if (_thread.joinable())
+            _thread.join();
+
+        clear();
+        delete _head;
+    }
+
+    CriminisiInpainter &CriminisiAsyncInpainter::inpainter()
+    {
+        return _inpainter;
+    }
+
+    void CriminisiAsyncInpainter::setObserver(ProgressObserver *observer)
+    {
+        _observer = observer;
+    }
+
+    void CriminisiAsyncInpainter::start(double timeBudget)
+    {
+        CV_Assert(!_thread.joinable());
+
+        clear();
+        _cancel.reset();
+        _error = std::exception_ptr();
+        _progress.store(0.f);
+        _finished.store(false);
+
+        _thread = std::thread(&CriminisiAsyncInpainter::work, this, timeBudget);
+    }
+
+    void CriminisiAsyncInpainter::cancel()
+    {
+        _cancel.cancel();
+    }
+
+    void CriminisiAsyncInpainter::wait()
+    {
+        if (_thread.joinable())
+            _thread.join();
+
+        if (_error) {
+            std::exception_ptr e = _error;
+            _error = std::exception_ptr();
+            std::rethrow_exception(e);
+        }
+    }
+
+    bool CriminisiAsyncInpainter::finished() const
+    {
+        return _finished.load();
+    }
+
+    float CriminisiAsyncInpainter::progress() const
+    {
+        return _progress.load();
+    }
+
+    bool CriminisiAsyncInpainter::poll(cv::Mat &image, cv::Mat &targetRegion, std::vector<cv::Rect> &dirty)
+    {
+        dirty.clear();
+
+        // The consumed node is released once its successor has been taken over, so the
+        // worker only ever links to nodes the viewer has not freed.
+        for (Update *u = _head->next.load(std::memory_order_acquire); u; u = _head->next.load(std::memory_order_acquire)) {
+            if (!image.empty())
+                u->image.copyTo(image(u->region));
+            if (!targetRegion.empty())
+                u->targetRegion.copyTo(targetRegion(u->region));
+            dirty.push_back(u->region);
+
+            delete _head;
+            _head = u;
+        }
+
+        return !dirty.empty();
+    }
+
+    void CriminisiAsyncInpainter::work(double timeBudget)
+    {
+        try {
+            Worker w(*this);
+            _inpainter.initialize();
+            _inpainter.run(timeBudget, &_cancel, &w);
+        } catch (...) {
+            _error = std::current_exception();
+        }
+
+        _finished.store(true);
+    }
+
+    void CriminisiAsyncInpainter::publish()
+    {
+        const cv::Mat image = _inpainter.image();
+        const cv::Mat targetRegion = _inpainter.targetRegion();
+        const cv::Rect all(0, 0, image.cols, image.rows);
+
+        _inpainter.changedRegions(_changed);
+        for (size_t i = 0; i < _changed.size(); ++i) {
+            Update *u = new Update();
+            u->region = _changed[i] & all;
+            image(u->region).copyTo(u->image);
+            targetRegion(u->region).copyTo(u->targetRegion);
+
+            _tail->next.store(u, std::memory_order_release);
+            _tail = u;
+        }
+    }
+
+    void CriminisiAsyncInpainter::clear()
+    {
+        Update *u = _head->next.load();
+        while (u) {
+            Update *next = u->next.load();
+            delete u;
+            u = next;
+        }
+
+        _head->next.store(0);
+        _tail = _head;
+    }
+
+}
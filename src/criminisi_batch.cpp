@@ -0,0 +1,160 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <inpaint/criminisi_batch.h>
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+
+namespace Inpaint {
+
+    InpaintingJob::InpaintingJob()
+        : patchSize(9)
+    {}
+
+    InpaintingJob::InpaintingJob(cv::Mat image_, cv::Mat targetMask_, cv::Mat sourceMask_, int patchSize_)
+        : image(image_), targetMask(targetMask_), sourceMask(sourceMask_), patchSize(patchSize_)
+    {}
+
+    /** Scheduling key of a job. Jobs are grouped by image size, largest first, then by cost. */
+    struct JobKey {
+        int area, width, height, type;
+        double cost;
+        int index;
+
+        bool operator<(const JobKey &o) const
+        {
+            if (area != o.area) return area > o.area;
+            if (width != o.width) return width > o.width;
+            if (height != o.height) return height > o.height;
+            if (type != o.type) return type < o.type;
+            if (cost != o.cost) return cost > o.cost;
+            return index < o.index;
+        }
+    };
+
+    /** Worker pulling jobs in scheduled order until none are left. */
+    class CriminisiBatchInpainter::WorkerBody : public cv::ParallelLoopBody {
+    public:
+        WorkerBody(std::vector<InpaintingJob> &jobs, const std::vector<int> &order, std::vector<CriminisiInpainter> &inpainters, std::atomic<int> &next)
+            : _jobs(jobs), _order(order), _inpainters(inpainters), _next(next)
+        {}
+
+        void operator()(const cv::Range &r) const
+        {
+            for (int w = r.start; w < r.end; ++w) {
+                CriminisiInpainter &ci = _inpainters[w];
+
+                for (int i = _next++; i < static_cast<int>(_order.size()); i = _next++) {
+                    InpaintingJob &job = _jobs[_order[i]];
+
+                    ci.setSourceImage(job.image);
+                    ci.setSourceMask(job.sourceMask);
+                    ci.setTargetMask(job.targetMask);
+                    ci.setPatchSize(job.patchSize);
+                    ci.initialize();
+
+                    while (ci.hasMoreSteps()) {
+                        ci.step();
+                    }
+
+                    ci.image().copyTo(job.image);
+                }
+            }
+        }
+
+    private:
+        std::vector<InpaintingJob> &_jobs;
+        const std::vector<int> &_order;
+        std::vector<CriminisiInpainter> &_inpainters;
+        std::atomic<int> &_next;
+    };
+
+    CriminisiBatchInpainter::CriminisiBatchInpainter()
+        : _nWorkers(0)
+    {}
+
+    void CriminisiBatchInpainter::setWorkers(int n)
+    {
+        _nWorkers = n;
+    }
+
+    void CriminisiBatchInpainter::run(std::vector<InpaintingJob> &jobs)
+    {
+        CV_Assert(_nWorkers >= 0);
+
+        const int n = static_cast<int>(jobs.size());
+        if (n == 0)
+            return;
+
+        // Jobs are validated up front, so invalid input does not throw on worker threads.
+        for (int i = 0; i < n; ++i) {
+            const InpaintingJob &job = jobs[i];
+            CV_Assert(!job.image.empty());
+            CV_Assert(job.image.channels() == 1 || job.image.channels() == 3);
+            CV_Assert(job.image.depth() == CV_8U || job.image.depth() == CV_16U || job.image.depth() == CV_32F);
+            CV_Assert(job.patchSize > 0);
+            CV_Assert(job.targetMask.type() == CV_8UC1 && job.targetMask.size() == job.image.size());
+            CV_Assert(job.sourceMask.empty() || (job.sourceMask.type() == CV_8UC1 && job.sourceMask.size() == job.image.size()));
+        }
+
+        // Consecutive jobs of the same size let a worker reuse its rasters. Within a size, each step scans
+        // the image and the number of steps grows with the target area, so expensive jobs go first.
+        std::vector<JobKey> keys(n);
+        for (int i = 0; i < n; ++i) {
+            const InpaintingJob &job = jobs[i];
+            JobKey &k = keys[i];
+            k.area = static_cast<int>(job.image.total());
+            k.width = job.image.cols;
+            k.height = job.image.rows;
+            k.type = job.image.type();
+            k.cost = (double)cv::countNonZero(job.targetMask) * job.image.total();
+            k.index = i;
+        }
+        std::sort(keys.begin(), keys.end());
+
+        _order.resize(n);
+        for (int i = 0; i < n; ++i)
+            _order[i] = keys[i].index;
+
+        // Workers process one job at a time, so searches within a job run serially.
+        const int nWorkers = std::max(1, std::min(_nWorkers > 0 ? _nWorkers : cv::getNumThreads(), n));
+        if (static_cast<int>(_inpainters.size()) < nWorkers) {
+            _inpainters.resize(nWorkers);
+        }
+        for (int w = 0; w < nWorkers; ++w) {
+            _inpainters[w].setSearchThreads(1);
+        }
+
+        std::atomic<int> next(0);
+        WorkerBody body(jobs, _order, _inpainters, next);
+        if (nWorkers == 1) {
+            body(cv::Range(0, 1));
+        } else {
+            cv::parallel_for_(cv::Range(0, nWorkers), body, nWorkers);
+        }
+    }
+
+    void inpaintCriminisiBatch(std::vector<InpaintingJob> &jobs)
+    {
+        CriminisiBatchInpainter b;
+        b.run(jobs);
+    }
+
+}
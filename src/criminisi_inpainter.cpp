@@ -19,20 +19,99 @@
 
 #include <inpaint/criminisi_inpainter.h>
 #include <inpaint/patch.h>
+#include <inpaint/patch_kernels.h>
+#include <inpaint/gradient.h>
+#include <inpaint/pyramid.h>
 #include <inpaint/timer.h>
 #include <inpaint/template_match_candidates.h>
 #include <opencv2/opencv.hpp>
+#include <cstring>
 
 namespace Inpaint {
 
-    const int PATCHFLAGS = PATCH_BOUNDS;
+    // Working rasters are padded, so patches around targets and sources never leave them.
+    const int PATCHFLAGS = PATCH_FAST;
+
+    // Source searches over fewer locations run serially, as dispatching bands would cost more than
+    // the scan itself. This applies to guided and local search windows in particular.
+    const int PARALLEL_SEARCH_MIN_CENTERS = 4096;
+    const int PARALLEL_SEARCH_MIN_BAND_ROWS = 8;
+
+    /**
+        Compute isophotes from image gradients of the given number of channels. Gradients are summed
+        over channels, scaled and rotated by 90 degrees.
+    */
+    template<int cn>
+    void computeIsophotes(const cv::Mat &gradX, const cv::Mat &gradY, float scale, cv::Mat_<float> &isophoteX, cv::Mat_<float> &isophoteY)
+    {
+        typedef cv::Vec<float, cn> Grad;
+
+        for (int y = 0; y < gradX.rows; ++y) {
+            const Grad *gxRow = gradX.ptr<Grad>(y);
+            const Grad *gyRow = gradY.ptr<Grad>(y);
+            float *ixRow = isophoteX.ptr<float>(y);
+            float *iyRow = isophoteY.ptr<float>(y);
+
+            for (int x = 0; x < gradX.cols; ++x) {
+                float gx = 0, gy = 0;
+                for (int c = 0; c < cn; ++c) {
+                    gx += gxRow[x][c];
+                    gy += gyRow[x][c];
+                }
+
+                ixRow[x] = -gy * scale;
+                iyRow[x] = gx * scale;
+            }
+        }
+    }
+
+    CriminisiStats::CriminisiStats()
+        : steps(0), patches(0), candidatesTested(0), fallbackSearches(0)
+    {
+        for (int i = 0; i < PHASE_COUNT; ++i) {
+            seconds[i] = 0;
+            calls[i] = 0;
+        }
+    }
+
+    void CriminisiStats::add(const CriminisiStats &other)
+    {
+        for (int i = 0; i < PHASE_COUNT; ++i) {
+            seconds[i] += other.seconds[i];
+            calls[i] += other.calls[i];
+        }
+        steps += other.steps;
+        patches += other.patches;
+        candidatesTested += other.candidatesTested;
+        fallbackSearches += other.fallbackSearches;
+    }
 
     CriminisiInpainter::UserSpecified::UserSpecified()
     {
         patchSize = 9;
+        normType = cv::NORM_L1;
+        searchThreads = 0;
+        pyramidLevels = 1;
+        pyramidSearchRadius = 4;
+        batchSize = 1;
+        sourceSearch = CriminisiInpainter::SOURCE_SEARCH_EXHAUSTIVE;
+        patchMatchIterations = 2;
+        indexNeighbors = 16;
+        projectionPruning = false;
+        spectralSearch = CriminisiInpainter::SPECTRAL_SEARCH_AUTO;
+        searchRadius = 0;
+        searchErrorThreshold = 10.f;
+        priorSearchRadius = -1;
+        profiling = false;
+        quickSearch = false;
     }
 
     CriminisiInpainter::CriminisiInpainter()
+        : _cachedHalfMatchSize(-1), _steps(0), _patches(0)
+    {}
+
+    CriminisiInpainter::SourceQuery::SourceQuery()
+        : candidatesTested(0), fallbacks(0), filterSeconds(0), filterCalls(0)
     {}
 
     void CriminisiInpainter::setSourceImage(const cv::Mat &bgrImage)
@@ -55,266 +134,1537 @@ namespace Inpaint {
         _input.patchSize = s;
     }
 
+    void CriminisiInpainter::setNormType(int normType)
+    {
+        _input.normType = normType;
+    }
+
+    void CriminisiInpainter::setSearchThreads(int n)
+    {
+        _input.searchThreads = n;
+    }
+
+    void CriminisiInpainter::setPyramidLevels(int levels)
+    {
+        _input.pyramidLevels = levels;
+    }
+
+    void CriminisiInpainter::setPyramidSearchRadius(int radius)
+    {
+        _input.pyramidSearchRadius = radius;
+    }
+
+    void CriminisiInpainter::setBatchSize(int k)
+    {
+        _input.batchSize = k;
+    }
+
+    void CriminisiInpainter::setSourceSearch(int method)
+    {
+        _input.sourceSearch = method;
+    }
+
+    void CriminisiInpainter::setPatchMatchIterations(int iterations)
+    {
+        _input.patchMatchIterations = iterations;
+    }
+
+    void CriminisiInpainter::setIndexNeighbors(int k)
+    {
+        _input.indexNeighbors = k;
+    }
+
+    void CriminisiInpainter::setProjectionPruning(bool enable)
+    {
+        _input.projectionPruning = enable;
+    }
+
+    void CriminisiInpainter::setSpectralSearch(int mode)
+    {
+        _input.spectralSearch = mode;
+    }
+
+    void CriminisiInpainter::setSearchRadius(int radius)
+    {
+        _input.searchRadius = radius;
+    }
+
+    void CriminisiInpainter::setSearchErrorThreshold(float threshold)
+    {
+        _input.searchErrorThreshold = threshold;
+    }
+
+    void CriminisiInpainter::setOffsetPrior(const cv::Mat &offsets)
+    {
+        _input.offsetPrior = offsets;
+    }
+
+    void CriminisiInpainter::setPriorSearchRadius(int radius)
+    {
+        _input.priorSearchRadius = radius;
+    }
+
+    void CriminisiInpainter::setProfiling(bool enable)
+    {
+        _input.profiling = enable;
+    }
+
+    void CriminisiInpainter::setQuickSearch(bool enable)
+    {
+        _input.quickSearch = enable;
+    }
+
     cv::Mat CriminisiInpainter::image() const
     {
-        return _image;
+        return _image.empty() ? _image : _image(_interior);
     }
 
     cv::Mat CriminisiInpainter::targetRegion() const
     {
-        return _targetRegion;
+        return _targetRegion.empty() ? cv::Mat(_targetRegion) : cv::Mat(_targetRegion(_interior));
+    }
+
+    cv::Mat CriminisiInpainter::sourceOffsets() const
+    {
+        return _sourceOffsets.empty() ? cv::Mat(_sourceOffsets) : cv::Mat(_sourceOffsets(_interior));
+    }
+
+    CriminisiStats CriminisiInpainter::stats() const
+    {
+        CriminisiStats s;
+        for (int i = 0; i < CriminisiStats::PHASE_COUNT; ++i) {
+            s.seconds[i] = _timer.total(i);
+            s.calls[i] = _timer.called(i);
+        }
+        s.steps = _steps;
+        s.patches = _patches;
+        for (size_t i = 0; i < _queries.size(); ++i) {
+            s.candidatesTested += _queries[i].candidatesTested;
+            s.fallbackSearches += _queries[i].fallbacks;
+        }
+        return s;
     }
 
     void CriminisiInpainter::initialize()
     {
-        CV_Assert(_input.image.channels() == 3);
-        CV_Assert(_input.image.depth() == CV_8U);
+        CV_Assert(_input.image.channels() == 1 || _input.image.channels() == 3);
+        CV_Assert(_input.image.depth() == CV_8U || _input.image.depth() == CV_16U || _input.image.depth() == CV_32F);
+        CV_Assert(_input.sourceSearch != SOURCE_SEARCH_INDEX || _input.image.depth() == CV_8U);
         CV_Assert( _input.targetMask.size() == _input.image.size());
         CV_Assert(_input.sourceMask.empty() || _input.targetMask.size() == _input.sourceMask.size());
         CV_Assert(_input.patchSize > 0);
+        CV_Assert(_input.pyramidLevels > 0);
+        CV_Assert(_input.batchSize > 0);
+        CV_Assert(_input.sourceSearch >= SOURCE_SEARCH_EXHAUSTIVE && _input.sourceSearch <= SOURCE_SEARCH_INDEX);
+        CV_Assert(_input.indexNeighbors > 0);
+        CV_Assert(_input.spectralSearch >= SPECTRAL_SEARCH_AUTO && _input.spectralSearch <= SPECTRAL_SEARCH_ALWAYS);
+        CV_Assert(_input.searchRadius >= 0);
+        CV_Assert(_input.offsetPrior.empty() || (_input.offsetPrior.type() == CV_32SC2 && _input.offsetPrior.size() == _input.image.size()));
+        CV_Assert(_input.patchMatchIterations >= 0);
+
+        if (_input.profiling) {
+            _timer.reset();
+        } else {
+            _timer.clear();
+        }
+        _steps = 0;
+        _patches = 0;
 
         _halfPatchSize = _input.patchSize / 2;
-        _halfMatchSize = (int) (_halfPatchSize * 1.25f);
-
-        _input.image.copyTo(_image);
-        _input.targetMask.copyTo(_targetRegion);
+        _halfMatchSize = halfMatchSizeForPatchSize(_input.patchSize);
+
+        // Work on copies padded by the match window size. The padding is reflected from the image for
+        // gradients, but neither target, known nor source, so matches never compare it. Every patch
+        // around a fill-front pixel or a source location then lies within the rasters, and targets
+        // may touch the image border.
+        const int b = _halfMatchSize;
+        _interior = cv::Rect(b, b, _input.image.cols, _input.image.rows);
+        const cv::Size padded(_interior.width + 2 * b, _interior.height + 2 * b);
+
+        cv::copyMakeBorder(_input.image, _image, b, b, b, b, cv::BORDER_REFLECT_101 | cv::BORDER_ISOLATED);
+        cv::copyMakeBorder(_input.targetMask, _targetRegion, b, b, b, b, cv::BORDER_CONSTANT | cv::BORDER_ISOLATED, cv::Scalar(0));
+
+        _knownRegion.create(padded);
+        _knownRegion.setTo(0);
+        cv::Mat knownInterior = _knownRegion(_interior);
+        cv::compare(_input.targetMask, 0, knownInterior, cv::CMP_EQ);
+
+        // Working buffers are only reallocated when the image size changes. The source region only
+        // depends on the masks, so it is kept when they equal those of the previous call.
+        const bool sameMasks = sourceRegionCached();
+        if (!sameMasks) {
+            cv::erode(_knownRegion, _sourceRegion, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(_halfMatchSize*2+1, _halfMatchSize*2+1)));
+
+            if (!_input.sourceMask.empty() && cv::countNonZero(_input.sourceMask) > 0) {
+                _scratchMask.create(_input.sourceMask.size());
+                cv::compare(_input.sourceMask, 0, _scratchMask, cv::CMP_EQ);
+                _sourceRegion(_interior).setTo(0, _scratchMask);
+            }
 
-        // Initialize regions
-        cv::rectangle(_targetRegion, cv::Rect(0, 0, _targetRegion.cols, _halfMatchSize), cv::Scalar(0), -1); // Top
-        cv::rectangle(_targetRegion, cv::Rect(0, 0, _halfMatchSize, _targetRegion.rows), cv::Scalar(0), -1); // Left
-        cv::rectangle(_targetRegion, cv::Rect(_targetRegion.cols - _halfMatchSize, 0, _targetRegion.cols, _targetRegion.rows), cv::Scalar(0), -1); // Bottom
-        cv::rectangle(_targetRegion, cv::Rect(0, _targetRegion.rows - _halfMatchSize, _targetRegion.cols, _targetRegion.rows), cv::Scalar(0), -1); // Right
+            _input.targetMask.copyTo(_cachedTargetMask);
+            _input.sourceMask.copyTo(_cachedSourceMask);
+            _cachedHalfMatchSize = _halfMatchSize;
 
-        _sourceRegion = 255 - _targetRegion;
-        cv::rectangle(_sourceRegion, cv::Rect(0, 0, _sourceRegion.cols, _sourceRegion.rows), cv::Scalar(0), _halfMatchSize);
-        cv::erode(_sourceRegion, _sourceRegion, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(_halfMatchSize*2+1, _halfMatchSize*2+1)));
+            // Centers of a previous source region are stale, even if a search mode did not use them.
+            _sourceCenters.clear();
+        }
 
-        if (!_input.sourceMask.empty() && cv::countNonZero(_input.sourceMask) > 0) {
-            _sourceRegion.setTo(0, (_input.sourceMask == 0));
+        // Matching takes place on integer values. Floating point images are mapped linearly to 16-bit
+        // based on the range of known values, while patches are still copied from the original.
+        if (_image.depth() == CV_32F) {
+            mapToSearchImage();
+        } else {
+            _searchImage = _image;
         }
+        _useCandidateFilter = _searchImage.depth() == CV_8U;
 
         // Initialize isophote values. Deviating from the original paper here. We've found that
         // blurring the image balances the data term and the confidence term better.
-        cv::Mat blurred;
-        cv::blur(_image, blurred, cv::Size(3,3));
-        cv::Mat_<cv::Vec3f> gradX, gradY;
-        cv::Sobel(blurred, gradX, CV_32F, 1, 0, 3, 1, 0, cv::BORDER_REPLICATE);
-        cv::Sobel(blurred, gradY, CV_32F, 0, 1, 3, 1, 0, cv::BORDER_REPLICATE);
+        cv::blur(_searchImage, _blurred, cv::Size(3,3));
+        cv::Sobel(_blurred, _gradX, CV_32F, 1, 0, 3, 1, 0, cv::BORDER_REPLICATE);
+        cv::Sobel(_blurred, _gradY, CV_32F, 0, 1, 3, 1, 0, cv::BORDER_REPLICATE);
+
+        _isophoteX.create(_gradX.size());
+        _isophoteY.create(_gradY.size());
+
+        const float scale = 1.f / (_searchImage.channels() * (_searchImage.depth() == CV_8U ? 255.f : 65535.f));
+        if (_searchImage.channels() == 1) {
+            computeIsophotes<1>(_gradX, _gradY, scale, _isophoteX, _isophoteY);
+        } else {
+            computeIsophotes<3>(_gradX, _gradY, scale, _isophoteX, _isophoteY);
+        }
 
-        _isophoteX.create(gradX.size());
-        _isophoteY.create(gradY.size());
+        // Initialize confidence values. Padding counts as unknown.
+        _confidence.create(_image.size());
+        _confidence.setTo(0);
+        _confidence.setTo(1, _knownRegion);
+
+        _patchConfidence.create(_image.size());
+        updatePatchConfidence(cv::Rect(0, 0, _image.cols, _image.rows));
+
+        // Configure valid source locations considered during algorithm
+        _startX = _interior.x + _halfMatchSize;
+        _startY = _interior.y + _halfMatchSize;
+        _endX = _interior.x + _interior.width - _halfMatchSize - 1;
+        _endY = _interior.y + _interior.height - _halfMatchSize - 1;
+
+        // Initialize fill-front. From here on it is maintained incrementally.
+        _borderRegion.create(_targetRegion.size());
+        _borderRegion.setTo(0);
+        _frontQueue.reset(_targetRegion.rows * _targetRegion.cols);
+        updateFillFront(cv::Rect(0, 0, _targetRegion.cols, _targetRegion.rows));
+        _remainingTargetPixels = cv::countNonZero(_targetRegion);
+        _initialTargetPixels = _remainingTargetPixels;
 
-        for (int i = 0; i < gradX.rows * gradX.cols; ++i) {
-            // Note the isophote corresponds to the gradient rotated by 90 degrees
-            const cv::Vec3f &vx = gradX(i);
-            const cv::Vec3f &vy = gradY(i);
+        // Setup template match performance improvement
+        if (_useCandidateFilter) {
+            _tmc.setSourceImage(_searchImage);
+            _tmc.setTemplateSize(cv::Size(_halfMatchSize * 2 + 1, _halfMatchSize * 2 + 1));
+            _tmc.setPartitionSize(cv::Size(3,3));
+            _tmc.initialize();
+        }
 
-            float x = (vx[0] + vx[1] + vx[2]) / (3 * 255);
-            float y = (vy[0] + vy[1] + vy[2]) / (3 * 255);
+        _queries.resize(_input.batchSize);
+        for (size_t i = 0; i < _queries.size(); ++i) {
+            _queries[i].distance.setNormType(_input.normType);
+            _queries[i].rng = cv::RNG(0x9e3779b9u + static_cast<unsigned>(i));
+            _queries[i].candidatesTested = 0;
+            _queries[i].fallbacks = 0;
+            _queries[i].filterSeconds = 0;
+            _queries[i].filterCalls = 0;
+        }
+        _hasPreviousOffset = false;
+        _batchTargets.clear();
+
+        // Valid source locations never change, so approximate searches index them once.
+        if (_input.sourceSearch != SOURCE_SEARCH_EXHAUSTIVE && !(sameMasks && !_sourceCenters.empty())) {
+            _sourceCenters.clear();
+            for (int y = _startY; y < _endY; ++y) {
+                const uchar *sRow = _sourceRegion.ptr(y);
+                for (int x = _startX; x < _endX; ++x) {
+                    if (sRow[x] > 0)
+                        _sourceCenters.push_back(cv::Point(x, y));
+                }
+            }
+        }
 
-            std::swap(x, y);
-            x *= -1;
+        // Nearest neighbor field of target locations used by PatchMatch search.
+        if (_input.sourceSearch == SOURCE_SEARCH_PATCHMATCH) {
+            _nnf.create(_image.size());
+            _nnf.setTo(cv::Scalar::all(-1));
+        }
 
-            _isophoteX(i) = x;
-            _isophoteY(i) = y;
+        if (_input.sourceSearch == SOURCE_SEARCH_INDEX) {
+            _sourceIndex.build(_searchImage, _sourceCenters, _halfMatchSize);
         }
 
-        // Initialize confidence values
-        _confidence.create(_image.size());
-        _confidence.setTo(1);
-        _confidence.setTo(0, _targetRegion);
+        _projections.clear();
+        if (_input.projectionPruning && _searchImage.depth() == CV_8U) {
+            _projections.build(_searchImage, _sourceRegion, _halfMatchSize);
+        }
 
-        // Configure valid image region considered during algorithm
-        _startX = _halfMatchSize;
-        _startY = _halfMatchSize;
-        _endX = _image.cols - _halfMatchSize - 1;
-        _endY = _image.rows - _halfMatchSize - 1;
+        // Spectra are only worth computing when patches are large enough to pay off.
+        _spectral.clear();
+        const bool spectralApplicable = _input.normType == cv::NORM_L2SQR && _input.sourceSearch == SOURCE_SEARCH_EXHAUSTIVE && _searchImage.depth() == CV_8U;
+        if (spectralApplicable &&
+            (_input.spectralSearch == SPECTRAL_SEARCH_ALWAYS ||
+             (_input.spectralSearch == SPECTRAL_SEARCH_AUTO && 2 * _halfMatchSize + 1 >= 15)))
+        {
+            _spectral.setImage(_searchImage, cv::Size(2 * _halfMatchSize + 1, 2 * _halfMatchSize + 1));
+        }
 
-        // Setup template match performance improvement
-        _tmc.setSourceImage(_image);
-        _tmc.setTemplateSize(cv::Size(_halfMatchSize * 2 + 1, _halfMatchSize * 2 + 1));
-        _tmc.setPartitionSize(cv::Size(3,3));
-        _tmc.initialize();
+        _sourceOffsets.create(_image.size());
+        _sourceOffsets.setTo(cv::Scalar::all(0));
+
+        if (_input.pyramidLevels > 1) {
+            initializeGuide();
+        } else {
+            _guide.release();
+        }
+
+        if (_input.offsetPrior.empty()) {
+            _prior.release();
+        } else {
+            padField(_input.offsetPrior, _prior);
+        }
+
+        if (_input.profiling)
+            _timer.measure(CriminisiStats::PHASE_INITIALIZE);
+    }
+
+    void CriminisiInpainter::mapToSearchImage()
+    {
+        // Target pixels may hold arbitrary values, such as NaN, so only known pixels define the range.
+        double minValue = std::numeric_limits<double>::max(), maxValue = -std::numeric_limits<double>::max();
+        for (int c = 0; c < _image.channels(); ++c) {
+            cv::extractChannel(_image, _channelScratch, c);
+
+            double lo, hi;
+            cv::minMaxLoc(_channelScratch, &lo, &hi, 0, 0, _knownRegion);
+            minValue = std::min(minValue, lo);
+            maxValue = std::max(maxValue, hi);
+        }
+
+        const double scale = maxValue > minValue ? 65535.0 / (maxValue - minValue) : 0.0;
+        _image.convertTo(_searchImage, CV_16U, scale, -minValue * scale);
+    }
+
+    bool CriminisiInpainter::sourceRegionCached() const
+    {
+        if (_sourceRegion.empty() || _cachedHalfMatchSize != _halfMatchSize)
+            return false;
+
+        return sameMask(_input.targetMask, _cachedTargetMask) && sameMask(_input.sourceMask, _cachedSourceMask);
+    }
+
+    bool CriminisiInpainter::sameMask(const cv::Mat &a, const cv::Mat &b)
+    {
+        if (a.empty() || b.empty())
+            return a.empty() && b.empty();
+        if (a.size() != b.size() || a.type() != b.type())
+            return false;
+
+        for (int y = 0; y < a.rows; ++y) {
+            if (std::memcmp(a.ptr(y), b.ptr(y), a.cols * a.elemSize()) != 0)
+                return false;
+        }
+        return true;
+    }
+
+    void CriminisiInpainter::reserve(cv::Size size, int type)
+    {
+        const int cn = CV_MAT_CN(type);
+        const int searchType = CV_MAT_DEPTH(type) == CV_32F ? CV_MAKETYPE(CV_16U, cn) : type;
+
+        // Rasters are padded as in initialize(), which depends on the patch size set.
+        const int b = halfMatchSizeForPatchSize(_input.patchSize);
+        _interior = cv::Rect(b, b, size.width, size.height);
+        const cv::Size padded(size.width + 2 * b, size.height + 2 * b);
+
+        _image.create(padded, type);
+        if (searchType != type) {
+            _searchImage.create(padded, searchType);
+            _channelScratch.create(padded, CV_32FC1);
+        }
+        _blurred.create(padded, searchType);
+        _gradX.create(padded, CV_MAKETYPE(CV_32F, cn));
+        _gradY.create(padded, CV_MAKETYPE(CV_32F, cn));
+        _targetRegion.create(padded);
+        _knownRegion.create(padded);
+        _borderRegion.create(padded);
+        _sourceRegion.create(padded);
+        _scratchMask.create(size);
+        _isophoteX.create(padded);
+        _isophoteY.create(padded);
+        _confidence.create(padded);
+        _patchConfidence.create(padded);
+        _sourceOffsets.create(padded);
+        _frontQueue.reserve(padded.area());
+        if (CV_MAT_DEPTH(searchType) == CV_8U) {
+            _tmc.reserve(padded, cn);
+            if (_input.projectionPruning)
+                _projections.reserve(padded, cn, b);
+        }
+
+        // The source region needs to be recomputed in new buffers.
+        _cachedHalfMatchSize = -1;
+    }
+
+    void CriminisiInpainter::shrink()
+    {
+        _image.release();
+        _searchImage.release();
+        _channelScratch.release();
+        _blurred.release();
+        _gradX.release();
+        _gradY.release();
+        _targetRegion.release();
+        _knownRegion.release();
+        _borderRegion.release();
+        _sourceRegion.release();
+        _scratchMask.release();
+        _isophoteX.release();
+        _isophoteY.release();
+        _confidence.release();
+        _patchConfidence.release();
+        _sourceOffsets.release();
+        _guide.release();
+        _nnf.release();
+        _prior.release();
+        _cachedTargetMask.release();
+        _cachedSourceMask.release();
+
+        _tmc = TemplateMatchCandidates();
+        _frontQueue = IndexedMaxHeap();
+        _sourceIndex = SourcePatchIndex();
+        _projections = PatchProjections();
+        _spectral = SpectralPatchDistance();
+
+        std::vector<SourceQuery>().swap(_queries);
+        std::vector<cv::Point>().swap(_sourceCenters);
+        std::vector<cv::Point>().swap(_batchTargets);
+        std::vector<cv::Point>().swap(_batchSources);
+        std::vector< std::pair<int, float> >().swap(_batchPopped);
+        std::vector<cv::Point>().swap(_frontBatch);
+        std::vector<float>().swap(_frontNormalsX);
+        std::vector<float>().swap(_frontNormalsY);
+        std::vector<double>().swap(_columnSums);
+
+        _remainingTargetPixels = 0;
+        _initialTargetPixels = 0;
+    }
+
+    void CriminisiInpainter::initializeGuide()
+    {
+        // Build pyramids. Coarse target masks contain a pixel if any of the fine pixels it covers
+        // is to be inpainted, coarse source masks only if all of them are allowed as source.
+        const int levels = _input.pyramidLevels;
+        const cv::Size minSize(_input.image.cols >> (levels - 1), _input.image.rows >> (levels - 1));
+
+        std::vector<cv::Mat> images, targetMasks, sourceMasks;
+        imagePyramid(_input.image, images, minSize, cv::INTER_AREA);
+        imagePyramid(_input.targetMask != 0, targetMasks, minSize, cv::INTER_AREA);
+        if (!_input.sourceMask.empty()) {
+            imagePyramid(_input.sourceMask != 0, sourceMasks, minSize, cv::INTER_AREA);
+        }
+
+        // Skip levels too small to hold a reasonable number of patches.
+        int coarsest = static_cast<int>(images.size()) - 1;
+        while (coarsest > 0 && std::min(images[coarsest].cols, images[coarsest].rows) < 4 * _input.patchSize) {
+            --coarsest;
+        }
+
+        // Inpaint from coarse to fine. Each level is guided by the offsets found on the level below.
+        cv::Mat guide;
+        for (int level = coarsest; level > 0; --level) {
+            CriminisiInpainter ci;
+            ci.setSourceImage(images[level]);
+            ci.setTargetMask(targetMasks[level] > 0);
+            if (!sourceMasks.empty())
+                ci.setSourceMask(sourceMasks[level] == 255);
+            ci.setPatchSize(_input.patchSize);
+            ci.setNormType(_input.normType);
+            ci.setSearchThreads(_input.searchThreads);
+            ci.setSourceSearch(_input.sourceSearch);
+            ci.setPatchMatchIterations(_input.patchMatchIterations);
+            ci.setIndexNeighbors(_input.indexNeighbors);
+            ci.setProjectionPruning(_input.projectionPruning);
+            ci.setSpectralSearch(_input.spectralSearch);
+            ci.setSearchRadius(_input.searchRadius);
+            ci.setSearchErrorThreshold(_input.searchErrorThreshold);
+            ci.setPyramidSearchRadius(_input.pyramidSearchRadius);
+            ci.initialize();
+
+            if (!guide.empty()) {
+                ci.padField(upsampleOffsets(guide, images[level].size()), ci._guide);
+            }
+
+            while (ci.hasMoreSteps()) {
+                ci.step();
+            }
+
+            guide = ci.sourceOffsets();
+        }
+
+        if (guide.empty()) {
+            _guide.release();
+        } else {
+            padField(upsampleOffsets(guide, _interior.size()), _guide);
+        }
+    }
+
+    void CriminisiInpainter::padField(const cv::Mat &offsets, cv::Mat_<cv::Vec2i> &padded) const
+    {
+        const int b = _interior.x;
+        cv::copyMakeBorder(offsets, padded, b, b, b, b, cv::BORDER_CONSTANT | cv::BORDER_ISOLATED, cv::Scalar::all(0));
+    }
+
+    int CriminisiInpainter::halfMatchSizeForPatchSize(int patchSize)
+    {
+        // Keeps a one pixel margin for sparse gradients.
+        return std::max((int) ((patchSize / 2) * 1.25f), 1);
+    }
+
+    cv::Mat_<cv::Vec2i> CriminisiInpainter::upsampleOffsets(const cv::Mat_<cv::Vec2i> &offsets, cv::Size size)
+    {
+        cv::Mat_<cv::Vec2i> up;
+        cv::resize(offsets, up, size, 0, 0, cv::INTER_NEAREST);
+
+        const double sx = (double)size.width / offsets.cols;
+        const double sy = (double)size.height / offsets.rows;
+
+        for (int i = 0; i < up.rows * up.cols; ++i) {
+            up(i)[0] = cvRound(up(i)[0] * sx);
+            up(i)[1] = cvRound(up(i)[1] * sy);
+        }
+
+        return up;
     }
 
     bool CriminisiInpainter::hasMoreSteps()
     {
-        return cv::countNonZero(_targetRegion) > 0;
+        return _remainingTargetPixels > 0;
+    }
+
+    float CriminisiInpainter::progress() const
+    {
+        if (_initialTargetPixels <= 0)
+            return 1.f;
+        return 1.f - (float)_remainingTargetPixels / _initialTargetPixels;
+    }
+
+    void CriminisiInpainter::changedRegions(std::vector<cv::Rect> &regions) const
+    {
+        const int h = _halfPatchSize;
+        const cv::Rect image(0, 0, _interior.width, _interior.height);
+        regions.clear();
+        for (size_t i = 0; i < _batchTargets.size(); ++i) {
+            const cv::Point t = _batchTargets[i] - _interior.tl();
+            regions.push_back(cv::Rect(t.x - h, t.y - h, 2 * h + 1, 2 * h + 1) & image);
+        }
     }
 
+    /** Restores a flag to its value at construction when going out of scope. */
+    class RestoreFlag {
+    public:
+        RestoreFlag(bool &flag)
+            : _flag(flag), _value(flag)
+        {}
+
+        ~RestoreFlag()
+        {
+            _flag = _value;
+        }
+
+    private:
+        bool &_flag;
+        bool _value;
+    };
+
+    bool CriminisiInpainter::run(double timeBudget, const CancellationToken *cancel, ProgressObserver *observer)
+    {
+        // Quick search is only enabled for the remainder of this run, even if a step or the observer throws.
+        RestoreFlag restoreQuickSearch(_input.quickSearch);
+
+        Timer timer;
+        double elapsed = 0, regularSeconds = 0;
+        int regularPixels = 0;
+
+        while (hasMoreSteps()) {
+            if (cancel && cancel->cancelled())
+                break;
+
+            // Switch to quick search once the remaining pixels at the rate observed so far would exceed the budget.
+            if (timeBudget >= 0 && !_input.quickSearch) {
+                const double secondsPerPixel = regularPixels > 0 ? regularSeconds / regularPixels : 0.0;
+                if (elapsed + secondsPerPixel * _remainingTargetPixels > timeBudget)
+                    _input.quickSearch = true;
+            }
+
+            const int remaining = _remainingTargetPixels;
+            step();
+
+            const double seconds = timer.measure();
+            elapsed += seconds;
+            if (!_input.quickSearch) {
+                regularSeconds += seconds;
+                regularPixels += remaining - _remainingTargetPixels;
+            }
+
+            if (observer)
+                observer->progress(progress());
+        }
+
+        return !hasMoreSteps();
+    }
+
+    /** Searches sources of a batch of target patches concurrently. */
+    class CriminisiInpainter::BatchSearchBody : public cv::ParallelLoopBody {
+    public:
+        BatchSearchBody(CriminisiInpainter &ci)
+            : _ci(ci)
+        {}
+
+        void operator()(const cv::Range &r) const
+        {
+            for (int i = r.start; i < r.end; ++i) {
+                _ci._batchSources[i] = _ci.findSourcePatchLocation(_ci._queries[i], _ci._batchTargets[i], 1);
+            }
+        }
+
+    private:
+        CriminisiInpainter &_ci;
+    };
+
     void CriminisiInpainter::step()
     {
-        // We also need an updated knowledge of gradients in the border region
-        updateFillFront();
+        const bool profiling = _input.profiling;
+        if (profiling)
+            _timer.restart();
+
+        // Select the best target patches on the boundary to be inpainted.
+        if (_input.batchSize == 1) {
+            _batchTargets.assign(1, findTargetPatchLocation());
+        } else {
+            findTargetPatchLocations(_input.batchSize, _batchTargets);
+        }
+
+        if (profiling)
+            _timer.measure(CriminisiStats::PHASE_TARGET_SELECTION);
+
+        // Determine the best matching source patches from which to inpaint. Target patches of a batch
+        // do not influence each other, so their searches run concurrently.
+        const int n = static_cast<int>(_batchTargets.size());
+        _batchSources.resize(n);
+        if (n == 1) {
+            const int nThreads = _input.searchThreads > 0 ? _input.searchThreads : cv::getNumThreads();
+            _batchSources[0] = findSourcePatchLocation(_queries[0], _batchTargets[0], nThreads);
+        } else {
+            cv::parallel_for_(cv::Range(0, n), BatchSearchBody(*this), n);
+        }
+
+        if (profiling) {
+            _timer.measure(CriminisiStats::PHASE_SOURCE_SEARCH);
+
+            // Filter timings are taken per query, possibly on other threads.
+            for (int i = 0; i < n; ++i) {
+                SourceQuery &q = _queries[i];
+                _timer.add(CriminisiStats::PHASE_CANDIDATE_FILTER, q.filterSeconds, q.filterCalls);
+                q.filterSeconds = 0;
+                q.filterCalls = 0;
+            }
+            _timer.restart();
+        }
+
+        // Patches are accessed unchecked, so a missing source must not reach propagation.
+        for (int i = 0; i < n; ++i) {
+            if (_batchSources[i].x < 0)
+                CV_Error(cv::Error::StsError, "No valid source patch found. The source region is empty or too small for the patch size.");
+        }
 
-        // Next, we need to select the best target patch on the boundary to be inpainted.
-        cv::Point targetPatchLocation = findTargetPatchLocation();
+        for (int i = 0; i < n; ++i) {
+            const cv::Point &t = _batchTargets[i];
+            const cv::Point &s = _batchSources[i];
 
-        // Determine the best matching source patch from which to inpaint.
-        cv::Point sourcePatchLocation = findSourcePatchLocation(targetPatchLocation, true);
-        if (sourcePatchLocation.x == -1)
-            sourcePatchLocation = findSourcePatchLocation(targetPatchLocation, false);
+            // Copy values
+            propagatePatch(t, s);
+            if (profiling)
+                _timer.measure(CriminisiStats::PHASE_PROPAGATION);
+
+            // Only the neighborhood of the patch just written needs to be revisited.
+            updateFillFront(cv::Rect(t.x - _halfPatchSize, t.y - _halfPatchSize, 2 * _halfPatchSize + 1, 2 * _halfPatchSize + 1));
+            if (profiling)
+                _timer.measure(CriminisiStats::PHASE_FILL_FRONT);
+
+            _previousOffset = s - t;
+            _hasPreviousOffset = true;
+        }
 
-        // Copy values
-        propagatePatch(targetPatchLocation, sourcePatchLocation);
+        ++_steps;
+        _patches += n;
     }
 
-    void CriminisiInpainter::updateFillFront()
+    void CriminisiInpainter::updateFillFront(const cv::Rect &changed)
     {
-        // 2nd order derivative used to find border.
-        cv::Laplacian(_targetRegion, _borderRegion, CV_8U, 3, 1, 0, cv::BORDER_REPLICATE);
+        const cv::Rect valid = _interior;
 
-        // Update confidence values along fill front.
-        for (int y = _startY; y < _endY; ++y) {
+        // A pixel is on the fill-front when it is known but has at least one unknown diagonal
+        // neighbor. This is equivalent to a positive response of the 3x3 Laplacian on the target mask.
+        // Membership can only change for pixels next to modified ones.
+        const cv::Rect m = cv::Rect(changed.x - 1, changed.y - 1, changed.width + 2, changed.height + 2) & valid;
+
+        for (int y = m.y; y < m.y + m.height; ++y) {
+            const uchar *tRow = _targetRegion.ptr(y);
+            const uchar *tRowAbove = _targetRegion.ptr(std::max(y - 1, 0));
+            const uchar *tRowBelow = _targetRegion.ptr(std::min(y + 1, _targetRegion.rows - 1));
+            uchar *bRow = _borderRegion.ptr(y);
+
+            for (int x = m.x; x < m.x + m.width; ++x) {
+                const int xl = std::max(x - 1, 0);
+                const int xr = std::min(x + 1, _targetRegion.cols - 1);
+
+                const bool onFront = tRow[x] == 0 &&
+                        (tRowAbove[xl] || tRowAbove[xr] || tRowBelow[xl] || tRowBelow[xr]);
+
+                bRow[x] = onFront ? 255 : 0;
+                if (!onFront)
+                    _frontQueue.remove(y * _targetRegion.cols + x);
+            }
+        }
+
+        // Re-prioritize fill-front pixels whose patch overlaps modified pixels (confidence term)
+        // or whose normal is affected by them (data term).
+        const int r = std::max(_halfPatchSize, 1);
+        const cv::Rect p = cv::Rect(changed.x - r, changed.y - r, changed.width + 2 * r, changed.height + 2 * r) & valid;
+
+        _frontBatch.clear();
+        for (int y = p.y; y < p.y + p.height; ++y) {
             const uchar *bRow = _borderRegion.ptr(y);
-            for (int x = _startX; x < _endX; ++x) {
+            for (int x = p.x; x < p.x + p.width; ++x) {
                 if (bRow[x] > 0) {
-                    // Update confidence for border item
-                    cv::Point p(x, y);
-                    _confidence(p) = confidenceForPatchLocation(p);
+                    _frontBatch.push_back(cv::Point(x, y));
                 }
             }
         }
+
+        // Fill-front normals are only needed at the pixels just collected.
+        const int n = static_cast<int>(_frontBatch.size());
+        _frontNormalsX.resize(n);
+        _frontNormalsY.resize(n);
+        if (n > 0) {
+            normalizedGradients(_targetRegion, &_frontBatch[0], n, &_frontNormalsX[0], &_frontNormalsY[0]);
+        }
+
+        for (int i = 0; i < n; ++i) {
+            const cv::Point &f = _frontBatch[i];
+            _frontQueue.push(f.y * _targetRegion.cols + f.x, priorityForPatchLocation(f, cv::Vec2f(_frontNormalsX[i], _frontNormalsY[i])));
+        }
     }
 
     cv::Point CriminisiInpainter::findTargetPatchLocation()
     {
-        // Sweep over all pixels in the border region and priorize them based on
-        // a confidence term (i.e how many pixels are already known) and a data term that prefers
-        // border pixels on strong edges running through them.
+        // The fill-front pixel with the highest priority is kept on top of the queue. Ties are
+        // resolved in scan order.
+        CV_Assert(!_frontQueue.empty());
 
-        float maxPriority = 0;
-        cv::Point bestLocation(0, 0);
+        const int key = _frontQueue.top();
+        return cv::Point(key % _targetRegion.cols, key / _targetRegion.cols);
+    }
 
-        _borderGradX.create(_targetRegion.size());
-        _borderGradY.create(_targetRegion.size());
-        cv::Sobel(_targetRegion, _borderGradX, CV_32F, 1, 0, 3, 1, 0, cv::BORDER_REPLICATE);
-        cv::Sobel(_targetRegion, _borderGradY, CV_32F, 0, 1, 3, 1, 0, cv::BORDER_REPLICATE);
+    void CriminisiInpainter::findTargetPatchLocations(int k, std::vector<cv::Point> &targets)
+    {
+        CV_Assert(!_frontQueue.empty());
 
-        for (int y = _startY; y < _endY; ++y) {
-            const uchar *bRow = _borderRegion.ptr(y);
-            const float *gxRow = _borderGradX.ptr<float>(y);
-            const float *gyRow = _borderGradY.ptr<float>(y);
-            const float *ixRow = _isophoteX.ptr<float>(y);
-            const float *iyRow = _isophoteY.ptr<float>(y);
+        // Take fill-front pixels in order of priority, skipping those whose match window overlaps
+        // the match window of a pixel already taken. Filling one of those patches then neither
+        // changes the template nor the confidence of another. At most a few candidates per patch
+        // are inspected, since skipped ones are usually clustered right next to those taken.
+        const int maxInspected = 8 * k;
+        const int minDistance = 2 * _halfMatchSize + 1;
+
+        targets.clear();
+        _batchPopped.clear();
+
+        while (!_frontQueue.empty() && static_cast<int>(targets.size()) < k && static_cast<int>(_batchPopped.size()) < maxInspected) {
+            const int key = _frontQueue.top();
+            _batchPopped.push_back(std::make_pair(key, _frontQueue.topPriority()));
+            _frontQueue.pop();
+
+            const cv::Point p(key % _targetRegion.cols, key / _targetRegion.cols);
+
+            bool independent = true;
+            for (size_t i = 0; i < targets.size() && independent; ++i) {
+                independent = std::abs(p.x - targets[i].x) >= minDistance || std::abs(p.y - targets[i].y) >= minDistance;
+            }
+
+            if (independent)
+                targets.push_back(p);
+        }
+
+        // Filled patches remove their fill-front pixels when the front is updated.
+        for (size_t i = 0; i < _batchPopped.size(); ++i) {
+            _frontQueue.push(_batchPopped[i].first, _batchPopped[i].second);
+        }
+    }
+
+    float CriminisiInpainter::priorityForPatchLocation(cv::Point p, cv::Vec2f normal)
+    {
+        // Priorize based on a confidence term (i.e how many pixels are already known) and a data
+        // term that prefers border pixels on strong edges running through them.
+
+        // Data term
+        const float d = fabs(normal[0] * _isophoteX(p) + normal[1] * _isophoteY(p)) + 0.0001f;
+
+        // Confidence term
+        const float c = confidenceForPatchLocation(p);
+
+        // Priority of patch
+        return c * d;
+    }
+
+    float CriminisiInpainter::confidenceForPatchLocation(cv::Point p)
+    {
+        return _patchConfidence(p);
+    }
+
+    void CriminisiInpainter::updatePatchConfidence(const cv::Rect &changed)
+    {
+        switch (_halfPatchSize) {
+        case 2: updatePatchConfidence<2>(changed); break;
+        case 3: updatePatchConfidence<3>(changed); break;
+        case 4: updatePatchConfidence<4>(changed); break;
+        case 5: updatePatchConfidence<5>(changed); break;
+        default: updatePatchConfidence<-1>(changed); break;
+        }
+    }
+
+    template<int H>
+    void CriminisiInpainter::updatePatchConfidence(const cv::Rect &changed)
+    {
+        // Mean confidence of patches is maintained using running sums. First vertical sums over
+        // patch height are kept per column, then these are slid horizontally across the patch width.
+        // Patches are clamped to image bounds.
+        const int h = H >= 0 ? H : _halfPatchSize;
+        const int rows = _confidence.rows;
+        const int cols = _confidence.cols;
+
+        // Patch centers whose patch overlaps changed pixels.
+        const cv::Rect a = cv::Rect(changed.x - h, changed.y - h, changed.width + 2 * h, changed.height + 2 * h) & cv::Rect(0, 0, cols, rows);
+        if (a.area() == 0)
+            return;
+
+        const int x0 = std::max(a.x - h, 0);
+        const int x1 = std::min(a.x + a.width + h, cols);
+        _columnSums.assign(x1 - x0, 0.0);
+
+        for (int y = std::max(a.y - h, 0); y < std::min(a.y + h + 1, rows); ++y) {
             const float *cRow = _confidence.ptr<float>(y);
+            for (int x = x0; x < x1; ++x)
+                _columnSums[x - x0] += cRow[x];
+        }
 
-            for (int x = _startX; x < _endX; ++x) {
-                if (bRow[x] > 0) {
+        for (int y = a.y; y < a.y + a.height; ++y) {
+            if (y > a.y) {
+                if (y + h < rows) {
+                    const float *cRow = _confidence.ptr<float>(y + h);
+                    for (int x = x0; x < x1; ++x)
+                        _columnSums[x - x0] += cRow[x];
+                }
+                if (y - h - 1 >= 0) {
+                    const float *cRow = _confidence.ptr<float>(y - h - 1);
+                    for (int x = x0; x < x1; ++x)
+                        _columnSums[x - x0] -= cRow[x];
+                }
+            }
 
-                    // Data term
-                    cv::Vec2f grad(gxRow[x], gyRow[x]);
-                    float dot = grad.dot(grad);
+            const int ny = std::min(y + h + 1, rows) - std::max(y - h, 0);
+            float *pRow = _patchConfidence.ptr<float>(y);
 
-                    if (dot == 0) {
-                        grad *= 0;
-                    } else {
-                        grad /= sqrtf(dot);
-                    }
+            double sum = 0;
+            for (int x = std::max(a.x - h, 0); x < std::min(a.x + h + 1, cols); ++x)
+                sum += _columnSums[x - x0];
 
-                    const float d = fabs(grad[0] * ixRow[x] + grad[1] * iyRow[x]) + 0.0001f;
+            for (int x = a.x; x < a.x + a.width; ++x) {
+                if (x > a.x) {
+                    if (x + h < cols)
+                        sum += _columnSums[x + h - x0];
+                    if (x - h - 1 >= 0)
+                        sum -= _columnSums[x - h - 1 - x0];
+                }
 
-                    // Confidence term
-                    const float c = cRow[x];
+                const int nx = std::min(x + h + 1, cols) - std::max(x - h, 0);
+                pRow[x] = (float)(sum / (nx * ny));
+            }
+        }
+    }
+
+    /** Scans row bands of source locations concurrently. */
+    class CriminisiInpainter::SourceSearchBody : public cv::ParallelLoopBody {
+    public:
+        SourceSearchBody(const CriminisiInpainter &ci, SourceQuery &q, cv::Rect centers, bool useCandidateFilter, int64 bound)
+            : _ci(ci), _q(q), _centers(centers), _useCandidateFilter(useCandidateFilter), _bound(bound)
+        {}
+
+        void operator()(const cv::Range &r) const
+        {
+            const int nBands = static_cast<int>(_q.bandMatches.size());
+            for (int b = r.start; b < r.end; ++b) {
+                const int yBegin = _centers.y + (_centers.height * b) / nBands;
+                const int yEnd = _centers.y + (_centers.height * (b + 1)) / nBands;
+                _q.bandMatches[b] = _ci.scanSourceRegion(_q, cv::Rect(_centers.x, yBegin, _centers.width, yEnd - yBegin), _useCandidateFilter, _bound);
+            }
+        }
 
-                    // Priority of patch
-                    const float prio = c * d;
+    private:
+        const CriminisiInpainter &_ci;
+        SourceQuery &_q;
+        cv::Rect _centers;
+        bool _useCandidateFilter;
+        int64 _bound;
+    };
 
-                    if (prio > maxPriority) {
-                        maxPriority = prio;
-                        bestLocation = cv::Point(x,y);
-                    }
+    CriminisiInpainter::SourceMatch::SourceMatch()
+        : location(-1, -1), error(std::numeric_limits<int64>::max()), tested(0)
+    {}
+
+    bool CriminisiInpainter::findFieldOffset(const cv::Mat_<cv::Vec2i> &field, cv::Point targetPatchLocation, cv::Point &offset) const
+    {
+        if (field.empty())
+            return false;
+
+        // The target location itself is known, so use the offset of the first pixel
+        // to be inpainted in its patch that has one.
+        const int h = _halfPatchSize;
+        for (int y = targetPatchLocation.y - h; y <= targetPatchLocation.y + h; ++y) {
+            for (int x = targetPatchLocation.x - h; x <= targetPatchLocation.x + h; ++x) {
+                const cv::Vec2i &o = field(y, x);
+                if (_targetRegion(y, x) && (o[0] != 0 || o[1] != 0)) {
+                    offset = cv::Point(o[0], o[1]);
+                    return true;
                 }
             }
         }
 
-        return bestLocation;
+        return false;
     }
 
-    float CriminisiInpainter::confidenceForPatchLocation(cv::Point p)
+    bool CriminisiInpainter::findGuidedSearchRegion(cv::Point targetPatchLocation, cv::Rect &centers) const
+    {
+        cv::Point o;
+        if (!findFieldOffset(_guide, targetPatchLocation, o))
+            return false;
+
+        const int r = _input.pyramidSearchRadius;
+        centers = cv::Rect(targetPatchLocation.x + o.x - r, targetPatchLocation.y + o.y - r, 2 * r + 1, 2 * r + 1);
+        return true;
+    }
+
+    double CriminisiInpainter::acceptableError(cv::Point targetPatchLocation) const
+    {
+        // Errors are accumulated over known pixels of the match window only.
+        const cv::Point t = targetPatchLocation;
+        const int known = cv::countNonZero(centeredPatch<PATCHFLAGS>(_knownRegion, t.y, t.x, _halfMatchSize));
+        return (double)_input.searchErrorThreshold * known * _searchImage.channels();
+    }
+
+    cv::Point CriminisiInpainter::findSourcePatchLocation(SourceQuery &q, cv::Point targetPatchLocation, int nThreads)
+    {
+        if (_input.sourceSearch == SOURCE_SEARCH_PATCHMATCH)
+            return patchMatchSourceLocation(q, targetPatchLocation);
+
+        // The index cannot be queried when no block of the target patch is entirely known.
+        // Such targets use the exhaustive search below.
+        // Counts searches over all source locations that only run because a cheaper one failed.
+        bool restricted = false;
+
+        if (_input.sourceSearch == SOURCE_SEARCH_INDEX) {
+            const cv::Point s = indexSourceLocation(q, targetPatchLocation);
+            if (s.x != -1)
+                return s;
+            restricted = true;
+        }
+
+        // When guided by a coarser level, search only near the upsampled coarse match first.
+        const cv::Rect centers(_startX, _startY, _endX - _startX, _endY - _startY);
+        cv::Point sourcePatchLocation(-1, -1);
+
+        cv::Rect guidedCenters;
+        if (findGuidedSearchRegion(targetPatchLocation, guidedCenters)) {
+            sourcePatchLocation = searchSourceRegion(q, targetPatchLocation, guidedCenters & centers, false, nThreads).location;
+            restricted = true;
+        }
+
+        // Search near the match of the previous frame, if it is still good enough.
+        cv::Point priorOffset;
+        if (sourcePatchLocation.x == -1 && _input.priorSearchRadius >= 0 && findFieldOffset(_prior, targetPatchLocation, priorOffset)) {
+            const int r = _input.priorSearchRadius;
+            const cv::Point p = targetPatchLocation + priorOffset;
+            const SourceMatch m = searchSourceRegion(q, targetPatchLocation, cv::Rect(p.x - r, p.y - r, 2 * r + 1, 2 * r + 1) & centers, false, nThreads);
+            if (m.location.x != -1 && (double)m.error <= acceptableError(targetPatchLocation))
+                sourcePatchLocation = m.location;
+            restricted = true;
+        }
+
+        // Quick search accepts any match, so only grows the window while it holds no valid source.
+        if (sourcePatchLocation.x == -1 && _input.quickSearch) {
+            const int r = _input.searchRadius > 0 ? _input.searchRadius : _input.patchSize;
+            sourcePatchLocation = searchLocalSourceRegion(q, targetPatchLocation, centers, r, std::numeric_limits<double>::max(), nThreads);
+            restricted = true;
+        }
+
+        if (sourcePatchLocation.x == -1 && _input.searchRadius > 0) {
+            sourcePatchLocation = searchLocalSourceRegion(q, targetPatchLocation, centers, _input.searchRadius, acceptableError(targetPatchLocation), nThreads);
+            restricted = true;
+        }
+        if (sourcePatchLocation.x == -1) {
+            q.fallbacks += restricted ? 1 : 0;
+            sourcePatchLocation = searchSourceRegion(q, targetPatchLocation, centers, _useCandidateFilter, nThreads).location;
+        }
+        if (sourcePatchLocation.x == -1 && _useCandidateFilter) {
+            ++q.fallbacks;
+            sourcePatchLocation = searchSourceRegion(q, targetPatchLocation, centers, false, nThreads).location;
+        }
+
+        return sourcePatchLocation;
+    }
+
+    cv::Point CriminisiInpainter::searchLocalSourceRegion(SourceQuery &q, cv::Point targetPatchLocation, cv::Rect centers, int radius, double maxError, int nThreads)
+    {
+        const cv::Point t = targetPatchLocation;
+
+        // Search windows around the target, doubling their radius until the best match is good enough.
+        // Windows skip the candidate filter, as its cost depends on the image size instead of the window.
+        // Once a window covers all source locations the regular search takes over.
+        for (int r = radius; ; r *= 2) {
+            const cv::Rect window = cv::Rect(t.x - r, t.y - r, 2 * r + 1, 2 * r + 1) & centers;
+            if (window == centers)
+                break;
+
+            const SourceMatch m = searchSourceRegion(q, t, window, false, nThreads);
+            if (m.location.x != -1 && (double)m.error <= maxError)
+                return m.location;
+        }
+
+        return cv::Point(-1, -1);
+    }
+
+    CriminisiInpainter::SourceMatch CriminisiInpainter::searchSourceRegion(SourceQuery &q, cv::Point targetPatchLocation, cv::Rect centers, bool useCandidateFilter, int nThreads)
+    {
+        if (centers.area() == 0)
+            return SourceMatch();
+
+        cv::Mat targetImagePatch = centeredPatch<PATCHFLAGS>(_searchImage, targetPatchLocation.y, targetPatchLocation.x, _halfMatchSize);
+        cv::Mat invTargetMask = centeredPatch<PATCHFLAGS>(_knownRegion, targetPatchLocation.y, targetPatchLocation.x, _halfMatchSize);
+        if (useCandidateFilter) {
+            if (_input.profiling) {
+                Timer t;
+                _tmc.findCandidates(targetImagePatch, invTargetMask, q.candidates, 3, 10);
+                q.filterSeconds += t.measure();
+                ++q.filterCalls;
+            } else {
+                _tmc.findCandidates(targetImagePatch, invTargetMask, q.candidates, 3, 10);
+            }
+        }
+
+        setQueryTemplate(q, targetImagePatch, invTargetMask);
+
+        if (useSpectralSearch(centers)) {
+            const SourceMatch m = spectralScanSourceRegion(q, targetImagePatch, invTargetMask, centers, useCandidateFilter);
+            q.candidatesTested += m.tested;
+            return m;
+        }
+
+        // Neighboring target patches tend to be filled from neighboring source patches. Evaluating
+        // the source at the offset used in the previous step provides a tight initial bound for
+        // terminating distance evaluations early. Candidates are only pruned when their distance
+        // is strictly larger than the bound, so the result is the same as without a bound.
+        // The match of the previous frame serves the same purpose in video.
+        int64 bound = std::numeric_limits<int64>::max();
+        if (_hasPreviousOffset) {
+            const cv::Point hint = targetPatchLocation + _previousOffset;
+            if (hint.inside(centers) && isSourceCandidate(q, hint, useCandidateFilter)) {
+                bound = q.distance(_searchImage, hint.y - _halfMatchSize, hint.x - _halfMatchSize);
+            }
+        }
+
+        cv::Point priorOffset;
+        if (findFieldOffset(_prior, targetPatchLocation, priorOffset)) {
+            const cv::Point hint = targetPatchLocation + priorOffset;
+            if (hint.inside(centers) && isSourceCandidate(q, hint, useCandidateFilter)) {
+                bound = std::min(bound, q.distance(_searchImage, hint.y - _halfMatchSize, hint.x - _halfMatchSize, bound));
+            }
+        }
+
+        // Split the search into row bands. Each band keeps its first best match in scan order,
+        // reducing bands in order then yields the same result as a serial scan.
+        const int nBands = centers.area() < PARALLEL_SEARCH_MIN_CENTERS ? 1 :
+                std::max(1, std::min(nThreads, centers.height / PARALLEL_SEARCH_MIN_BAND_ROWS));
+
+        q.bandMatches.assign(nBands, SourceMatch());
+        if (nBands == 1) {
+            q.bandMatches[0] = scanSourceRegion(q, centers, useCandidateFilter, bound);
+        } else {
+            cv::parallel_for_(cv::Range(0, nBands), SourceSearchBody(*this, q, centers, useCandidateFilter, bound), nBands);
+        }
+
+        SourceMatch best;
+        for (int b = 0; b < nBands; ++b) {
+            best.tested += q.bandMatches[b].tested;
+            if (q.bandMatches[b].error < best.error) {
+                best.error = q.bandMatches[b].error;
+                best.location = q.bandMatches[b].location;
+            }
+        }
+
+        q.candidatesTested += best.tested;
+        return best;
+    }
+
+    cv::Point CriminisiInpainter::patchMatchSourceLocation(SourceQuery &q, cv::Point targetPatchLocation)
+    {
+        const cv::Point t = targetPatchLocation;
+        const cv::Rect centers(_startX, _startY, _endX - _startX, _endY - _startY);
+
+        cv::Mat targetImagePatch = centeredPatch<PATCHFLAGS>(_searchImage, t.y, t.x, _halfMatchSize);
+        setQueryTemplate(q, targetImagePatch, centeredPatch<PATCHFLAGS>(_knownRegion, t.y, t.x, _halfMatchSize));
+
+        SourceMatch best;
+
+        // Propagation. Matches of neighboring front locations and the sources neighboring pixels were
+        // copied from are shifted to this location. This is the sparse counterpart of PatchMatch
+        // propagation, with the fill-front advancing instead of a scan over the whole field.
+        q.tested.clear();
+
+        const cv::Vec2i &own = _nnf(t);
+        if (own[0] >= 0)
+            testSourceCandidate(q, cv::Point(own[0], own[1]), best);
+
+        for (int y = t.y - 1; y <= t.y + 1; ++y) {
+            for (int x = t.x - 1; x <= t.x + 1; ++x) {
+                const cv::Vec2i &n = _nnf(y, x);
+                if (n[0] >= 0)
+                    testSourceCandidate(q, cv::Point(n[0] + t.x - x, n[1] + t.y - y), best);
+            }
+        }
+
+        const int h = _halfPatchSize;
+        for (int y = t.y - h; y <= t.y + h; ++y) {
+            const uchar *tRow = _targetRegion.ptr(y);
+            const cv::Vec2i *oRow = _sourceOffsets.ptr<cv::Vec2i>(y);
+            for (int x = t.x - h; x <= t.x + h; ++x) {
+                if (!tRow[x] && (oRow[x][0] != 0 || oRow[x][1] != 0))
+                    testSourceCandidate(q, cv::Point(t.x + oRow[x][0], t.y + oRow[x][1]), best);
+            }
+        }
+
+        if (_hasPreviousOffset)
+            testSourceCandidate(q, t + _previousOffset, best);
+
+        cv::Point priorOffset;
+        if (findFieldOffset(_prior, t, priorOffset))
+            testSourceCandidate(q, t + priorOffset, best);
+
+        cv::Rect guidedCenters;
+        if (findGuidedSearchRegion(t, guidedCenters))
+            testSourceCandidate(q, cv::Point(guidedCenters.x + guidedCenters.width / 2, guidedCenters.y + guidedCenters.height / 2), best);
+
+        // Random initialization when nothing could be propagated, e.g. for the first patch.
+        if (best.location.x == -1 && !_sourceCenters.empty()) {
+            for (int i = 0; i < 16; ++i)
+                testSourceCandidate(q, _sourceCenters[q.rng.uniform(0, static_cast<int>(_sourceCenters.size()))], best);
+        }
+
+        if (best.location.x == -1)
+            return best.location;
+
+        // Random search in exponentially shrinking windows around the best match.
+        for (int i = 0; i < _input.patchMatchIterations; ++i) {
+            for (int r = std::max(centers.width, centers.height); r >= 1; r /= 2) {
+                const cv::Rect w = cv::Rect(best.location.x - r, best.location.y - r, 2 * r + 1, 2 * r + 1) & centers;
+                testSourceCandidate(q, cv::Point(w.x + q.rng.uniform(0, w.width), w.y + q.rng.uniform(0, w.height)), best);
+            }
+        }
+
+        _nnf(t) = cv::Vec2i(best.location.x, best.location.y);
+        q.candidatesTested += best.tested;
+        return best.location;
+    }
+
+    cv::Point CriminisiInpainter::indexSourceLocation(SourceQuery &q, cv::Point targetPatchLocation)
+    {
+        const cv::Point t = targetPatchLocation;
+
+        cv::Mat targetImagePatch = centeredPatch<PATCHFLAGS>(_searchImage, t.y, t.x, _halfMatchSize);
+        cv::Mat invTargetMask = centeredPatch<PATCHFLAGS>(_knownRegion, t.y, t.x, _halfMatchSize);
+
+        if (!_sourceIndex.query(targetImagePatch, invTargetMask, _input.indexNeighbors, 32 * _input.indexNeighbors, q.neighbors, q.indexWorkspace))
+            return cv::Point(-1, -1);
+
+        // Re-rank approximate neighbors by exact distance. The previous offset is added as it
+        // is often the best choice along straight structures.
+        setQueryTemplate(q, targetImagePatch, invTargetMask);
+        q.tested.clear();
+
+        SourceMatch best;
+        if (_hasPreviousOffset)
+            testSourceCandidate(q, t + _previousOffset, best);
+
+        cv::Point priorOffset;
+        if (findFieldOffset(_prior, t, priorOffset))
+            testSourceCandidate(q, t + priorOffset, best);
+
+        for (size_t i = 0; i < q.neighbors.size(); ++i)
+            testSourceCandidate(q, q.neighbors[i], best);
+
+        q.candidatesTested += best.tested;
+        return best.location;
+    }
+
+    void CriminisiInpainter::testSourceCandidate(SourceQuery &q, cv::Point s, SourceMatch &best) const
+    {
+        if (s.x < _startX || s.y < _startY || s.x >= _endX || s.y >= _endY || !_sourceRegion(s))
+            return;
+
+        // Propagated candidates are often the same. Skip those already evaluated for this target.
+        for (size_t i = 0; i < q.tested.size(); ++i) {
+            if (q.tested[i] == s)
+                return;
+        }
+        q.tested.push_back(s);
+
+        ++best.tested;
+        if (usesProjections(q) && _projections.lowerBound(q.projection, s.y, s.x) >= best.error)
+            return;
+
+        const int64 error = q.distance(_searchImage, s.y - _halfMatchSize, s.x - _halfMatchSize, best.error);
+        if (error < best.error) {
+            best.error = error;
+            best.location = s;
+        }
+    }
+
+    void CriminisiInpainter::setQueryTemplate(SourceQuery &q, const cv::Mat &templ, const cv::Mat &mask) const
     {
-        cv::Mat_<float> c = centeredPatch<PATCHFLAGS>(_confidence, p.y, p.x, _halfPatchSize);
-        return (float)cv::sum(c)[0] / c.size().area();
+        q.distance.setTemplate(templ, mask);
+        if (!_projections.empty())
+            _projections.project(templ, mask, _input.normType, q.projection);
     }
 
-    cv::Point CriminisiInpainter::findSourcePatchLocation(cv::Point targetPatchLocation, bool useCandidateFilter)
+    bool CriminisiInpainter::usesProjections(const SourceQuery &q) const
     {
-        cv::Point bestLocation(-1, -1);
-        float bestError = std::numeric_limits<float>::max();
+        return !_projections.empty() && !q.projection.blocks.empty();
+    }
 
-        cv::Mat_<cv::Vec3b> targetImagePatch = centeredPatch<PATCHFLAGS>(_image, targetPatchLocation.y, targetPatchLocation.x, _halfMatchSize);
-        cv::Mat_<uchar> targetMask = centeredPatch<PATCHFLAGS>(_targetRegion, targetPatchLocation.y, targetPatchLocation.x, _halfMatchSize);
+    bool CriminisiInpainter::isSourceCandidate(const SourceQuery &q, cv::Point p, bool useCandidateFilter) const
+    {
+        // Note, candidates need to be corrected. Centered patch locations used here, top-left used with candidates.
+        return (!useCandidateFilter || q.candidates.at<uchar>(p.y - _halfMatchSize, p.x - _halfMatchSize)) &&
+                _sourceRegion(p) > 0;
+    }
+
+    CriminisiInpainter::SourceMatch CriminisiInpainter::scanSourceRegion(const SourceQuery &q, cv::Rect centers, bool useCandidateFilter, int64 bound) const
+    {
+        SourceMatch best;
+        const bool pruning = usesProjections(q);
 
-        cv::Mat invTargetMask = (targetMask == 0);
-        if (useCandidateFilter)
-            _tmc.findCandidates(targetImagePatch, invTargetMask, _candidates, 3, 10);
-        
-        int count = 0;
-        for (int y = _startY; y < _endY; ++y) {
-            for (int x = _startX; x < _endX; ++x) {
+        for (int y = centers.y; y < centers.y + centers.height; ++y) {
+            // Note, candidates need to be corrected. Centered patch locations used here, top-left used with candidates.
+            const uchar *cRow = useCandidateFilter ? q.candidates.ptr<uchar>(y - _halfMatchSize) : 0;
+            const uchar *sRow = _sourceRegion.ptr(y);
 
-                // Note, candidates need to be corrected. Centered patch locations used here, top-left used with candidates.
-                const bool shouldTest = (!useCandidateFilter || _candidates.at<uchar>(y - _halfMatchSize, x - _halfMatchSize)) &&
-                        _sourceRegion.at<uchar>(y, x) > 0;
+            for (int x = centers.x; x < centers.x + centers.width; ++x) {
+                const bool shouldTest = (!useCandidateFilter || cRow[x - _halfMatchSize]) && sRow[x] > 0;
 
                 if (shouldTest) {
-                    ++count;
-                    cv::Mat_<uchar> sourceMask = centeredPatch<PATCHFLAGS>(_sourceRegion, y, x, _halfMatchSize);
-                    cv::Mat_<cv::Vec3b> sourceImagePatch = centeredPatch<PATCHFLAGS>(_image, y, x, _halfMatchSize);
+                    ++best.tested;
+                    const int64 limit = std::min(bound, best.error);
+
+                    // Candidates whose distance provably exceeds the limit are rejected without reading pixels.
+                    if (pruning && _projections.lowerBound(q.projection, y, x) > limit)
+                        continue;
+
+                    const int64 error = q.distance(_searchImage, y - _halfMatchSize, x - _halfMatchSize, limit);
+
+                    // Evaluation stopped early if error exceeds limit, in which case it is only a partial sum.
+                    if (error <= limit && error < best.error) {
+                        best.error = error;
+                        best.location = cv::Point(x, y);
+                    }
+                }
+            }
+        }
+
+        return best;
+    }
+
+    bool CriminisiInpainter::useSpectralSearch(cv::Rect centers) const
+    {
+        if (_spectral.empty())
+            return false;
+        if (_input.spectralSearch == SPECTRAL_SEARCH_ALWAYS)
+            return true;
+
+        // Compare the cost of direct evaluation at every location to that of five transforms
+        // of image size. Pruning and early termination make direct evaluation cheaper than
+        // this estimate, which is accounted for by a constant factor.
+        const cv::Size n = _spectral.transformSize();
+        const double matchArea = (2 * _halfMatchSize + 1) * (2 * _halfMatchSize + 1);
+        const double directCost = (double)centers.area() * matchArea * _searchImage.channels();
+        const double spectralCost = 5.0 * n.area() * std::log((double)n.area()) / std::log(2.0);
+
+        return directCost > 8.0 * spectralCost;
+    }
+
+    CriminisiInpainter::SourceMatch CriminisiInpainter::spectralScanSourceRegion(SourceQuery &q, const cv::Mat &templ, const cv::Mat &mask, cv::Rect centers, bool useCandidateFilter) const
+    {
+        _spectral.compute(templ, mask, q.spectralDistances, q.spectralWorkspace);
 
-                    float error = (float)cv::norm(targetImagePatch, sourceImagePatch, cv::NORM_L1, invTargetMask);
+        const int h = _halfMatchSize;
 
-                    if (error < bestError) {
-                        bestError = error;
-                        bestLocation = cv::Point(x, y);
+        // Transforms are exact up to rounding. Locate the smallest approximate distance first.
+        double minValue = std::numeric_limits<double>::max();
+        for (int y = centers.y; y < centers.y + centers.height; ++y) {
+            const uchar *cRow = useCandidateFilter ? q.candidates.ptr<uchar>(y - h) : 0;
+            const uchar *sRow = _sourceRegion.ptr(y);
+            const double *dRow = q.spectralDistances.ptr<double>(y - h);
+
+            for (int x = centers.x; x < centers.x + centers.width; ++x) {
+                if ((!useCandidateFilter || cRow[x - h]) && sRow[x] > 0)
+                    minValue = std::min(minValue, dRow[x - h]);
+            }
+        }
+
+        // Then evaluate all locations close to it exactly, which yields the same match as the direct scan.
+        SourceMatch best;
+        if (minValue == std::numeric_limits<double>::max())
+            return best;
+
+        const double threshold = minValue + 1.0 + 1e-6 * std::abs(minValue);
+        for (int y = centers.y; y < centers.y + centers.height; ++y) {
+            const uchar *cRow = useCandidateFilter ? q.candidates.ptr<uchar>(y - h) : 0;
+            const uchar *sRow = _sourceRegion.ptr(y);
+            const double *dRow = q.spectralDistances.ptr<double>(y - h);
+
+            for (int x = centers.x; x < centers.x + centers.width; ++x) {
+                if ((!useCandidateFilter || cRow[x - h]) && sRow[x] > 0 && dRow[x - h] <= threshold) {
+                    ++best.tested;
+                    const int64 error = q.distance(_searchImage, y - h, x - h, best.error);
+                    if (error < best.error) {
+                        best.error = error;
+                        best.location = cv::Point(x, y);
                     }
                 }
             }
         }
 
-        return bestLocation;
+        return best;
     }
 
     void CriminisiInpainter::propagatePatch(cv::Point target, cv::Point source)
     {
-        cv::Mat_<uchar> copyMask = centeredPatch<PATCHFLAGS>(_targetRegion, target.y, target.x, _halfPatchSize);
+        // Patch sizes 5, 7, 9 and 11 use kernels unrolled for their size.
+        switch (_halfPatchSize) {
+        case 2: propagatePatch<2>(target, source); break;
+        case 3: propagatePatch<3>(target, source); break;
+        case 4: propagatePatch<4>(target, source); break;
+        case 5: propagatePatch<5>(target, source); break;
+        default: propagatePatch<-1>(target, source); break;
+        }
+    }
 
-        centeredPatch<PATCHFLAGS>(_image, source.y, source.x, _halfPatchSize).copyTo(
-                    centeredPatch<PATCHFLAGS>(_image, target.y, target.x, _halfPatchSize),
-                    copyMask);
+    template<int H>
+    void CriminisiInpainter::propagatePatch(cv::Point target, cv::Point source)
+    {
+        const int h = H >= 0 ? H : _halfPatchSize;
+
+        copyMaskedPatch<H>(_image, source, _image, target, _targetRegion, h);
+        if (_searchImage.data != _image.data)
+            copyMaskedPatch<H>(_searchImage, source, _searchImage, target, _targetRegion, h);
+
+        copyMaskedPatch<H, float>(_isophoteX, source, _isophoteX, target, _targetRegion, h);
+        copyMaskedPatch<H, float>(_isophoteY, source, _isophoteY, target, _targetRegion, h);
 
-        centeredPatch<PATCHFLAGS>(_isophoteX, source.y, source.x, _halfPatchSize).copyTo(
-                    centeredPatch<PATCHFLAGS>(_isophoteX, target.y, target.x, _halfPatchSize),
-                    copyMask);
+        fillMaskedPatch<H>(_sourceOffsets, target, _targetRegion, cv::Vec2i(source.x - target.x, source.y - target.y), h);
 
-        centeredPatch<PATCHFLAGS>(_isophoteY, source.y, source.x, _halfPatchSize).copyTo(
-                    centeredPatch<PATCHFLAGS>(_isophoteY, target.y, target.x, _halfPatchSize),
-                    copyMask);
+        const float cPatch = confidenceForPatchLocation(target);
+        fillMaskedPatch<H>(_confidence, target, _targetRegion, cPatch, h);
+        updatePatchConfidence<H>(cv::Rect(target.x - h, target.y - h, 2 * h + 1, 2 * h + 1));
+
+        fillMaskedPatch<H>(_knownRegion, target, _targetRegion, uchar(255), h);
+        _remainingTargetPixels -= clearMaskedPatch<H>(_targetRegion, target, h);
+    }
 
-        float cPatch = _confidence.at<float>(target);
-        centeredPatch<PATCHFLAGS>(_confidence, target.y, target.x, _halfPatchSize).setTo(cPatch, copyMask);
 
-        copyMask.setTo(0);
+    cv::Rect inpaintingRegionOfInterest(cv::InputArray targetMask, int contextMargin, int patchSize)
+    {
+        cv::Mat mask = targetMask.getMat();
+        const cv::Rect all(0, 0, mask.cols, mask.rows);
+
+        std::vector<cv::Point> targets;
+        cv::findNonZero(mask, targets);
+        if (targets.empty())
+            return cv::Rect();
+
+        // Content outside the crop is only seen as padding, which is never used as source. The
+        // border keeps known pixels around the target from which valid source patches can be taken.
+        const int border = contextMargin + 2 * CriminisiInpainter::halfMatchSizeForPatchSize(patchSize) + 1;
+        const cv::Rect r = cv::boundingRect(targets);
+
+        return cv::Rect(r.x - border, r.y - border, r.width + 2 * border, r.height + 2 * border) & all;
+    }
+
+    void inpaintingRegionsOfInterest(cv::InputArray targetMask, int contextMargin, int patchSize, std::vector<cv::Rect> &regions)
+    {
+        cv::Mat mask = targetMask.getMat() != 0;
+        const cv::Rect all(0, 0, mask.cols, mask.rows);
+        const int border = contextMargin + 2 * CriminisiInpainter::halfMatchSizeForPatchSize(patchSize) + 1;
+
+        cv::Mat labels, stats, centroids;
+        const int n = cv::connectedComponentsWithStats(mask, labels, stats, centroids, 8, CV_32S);
+
+        // Label zero is the background.
+        regions.clear();
+        for (int i = 1; i < n; ++i) {
+            const cv::Rect r(
+                stats.at<int>(i, cv::CC_STAT_LEFT), stats.at<int>(i, cv::CC_STAT_TOP),
+                stats.at<int>(i, cv::CC_STAT_WIDTH), stats.at<int>(i, cv::CC_STAT_HEIGHT));
+            regions.push_back(cv::Rect(r.x - border, r.y - border, r.width + 2 * border, r.height + 2 * border) & all);
+        }
+
+        // Merge overlapping regions until all are disjoint. A region then contains target pixels
+        // of its own components only, as any other component reaching into it would overlap.
+        bool merged = true;
+        while (merged) {
+            merged = false;
+            for (size_t i = 0; i < regions.size() && !merged; ++i) {
+                for (size_t j = i + 1; j < regions.size() && !merged; ++j) {
+                    if ((regions[i] & regions[j]).area() > 0) {
+                        regions[i] |= regions[j];
+                        regions.erase(regions.begin() + j);
+                        merged = true;
+                    }
+                }
+            }
+        }
     }
 
+    /** Inpaints disjoint regions of an image concurrently. */
+    class RegionInpaintBody : public cv::ParallelLoopBody {
+    public:
+        RegionInpaintBody(cv::Mat image, cv::Mat targetMask, cv::Mat sourceMask, const std::vector<cv::Rect> &regions, int patchSize, int pyramidLevels, std::vector<cv::Mat> &results, std::vector<CriminisiStats> *stats)
+            : _image(image), _targetMask(targetMask), _sourceMask(sourceMask), _regions(regions), _patchSize(patchSize), _pyramidLevels(pyramidLevels), _results(results), _stats(stats)
+        {}
+
+        void operator()(const cv::Range &r) const
+        {
+            for (int i = r.start; i < r.end; ++i) {
+                const cv::Rect &roi = _regions[i];
+
+                // Regions only read the shared image. Results are written back once all regions are done.
+                CriminisiInpainter ci;
+                ci.setSourceImage(_image(roi).clone());
+                ci.setSourceMask(_sourceMask.empty() ? _sourceMask : _sourceMask(roi).clone());
+                ci.setTargetMask(_targetMask(roi).clone());
+                ci.setPatchSize(_patchSize);
+                ci.setPyramidLevels(_pyramidLevels);
+                ci.setProfiling(_stats != 0);
+                ci.initialize();
+
+                while (ci.hasMoreSteps()) {
+                    ci.step();
+                }
+
+                ci.image().copyTo(_results[i]);
+                if (_stats)
+                    (*_stats)[i] = ci.stats();
+            }
+        }
+
+    private:
+        cv::Mat _image, _targetMask, _sourceMask;
+        const std::vector<cv::Rect> &_regions;
+        int _patchSize, _pyramidLevels;
+        std::vector<cv::Mat> &_results;
+        std::vector<CriminisiStats> *_stats;
+    };
 
     void inpaintCriminisi(
             cv::InputArray image,
             cv::InputArray targetMask,
             cv::InputArray sourceMask,
-            int patchSize)
+            int patchSize,
+            int pyramidLevels,
+            int contextMargin,
+            CriminisiStats *stats)
     {
+        cv::Mat img = image.getMat();
+        cv::Mat target = targetMask.getMat();
+        cv::Mat source = sourceMask.getMat();
+
+        // Disconnected parts of the target region whose regions do not overlap are independent.
+        std::vector<cv::Rect> regions;
+        if (contextMargin >= 0) {
+            inpaintingRegionsOfInterest(target, contextMargin, patchSize, regions);
+        } else {
+            regions.push_back(cv::Rect(0, 0, img.cols, img.rows));
+        }
+
+        // An empty source mask within a crop would lift the restriction for it. Such crops grow to the
+        // entire image, which then replaces all regions to keep them disjoint.
+        if (!source.empty() && cv::countNonZero(source) > 0) {
+            CV_Assert(source.size() == img.size());
+            for (size_t i = 0; i < regions.size(); ++i) {
+                if (cv::countNonZero(source(regions[i])) == 0) {
+                    regions.assign(1, cv::Rect(0, 0, img.cols, img.rows));
+                    break;
+                }
+            }
+        }
+
+        const int n = static_cast<int>(regions.size());
+        std::vector<CriminisiStats> regionStats(stats ? n : 0);
+        std::vector<cv::Mat> results(n);
+        RegionInpaintBody body(img, target, source, regions, patchSize, pyramidLevels, results, stats ? &regionStats : 0);
+        if (n == 1) {
+            body(cv::Range(0, 1));
+        } else if (n > 1) {
+            cv::parallel_for_(cv::Range(0, n), body, n);
+        }
+
+        // Only target pixels change, so results are copied through the target mask.
+        for (int i = 0; i < n; ++i) {
+            cv::Mat dst = img(regions[i]);
+            results[i].copyTo(dst, target(regions[i]));
+        }
+
+        if (stats) {
+            *stats = CriminisiStats();
+            for (int i = 0; i < n; ++i)
+                stats->add(regionStats[i]);
+        }
+    }
+
+    bool inpaintCriminisiBudgeted(
+            cv::InputArray image,
+            cv::InputArray targetMask,
+            cv::InputArray sourceMask,
+            int patchSize,
+            double timeBudget,
+            const CancellationToken *cancel,
+            ProgressObserver *observer)
+    {
+        cv::Mat img = image.getMat();
+
         CriminisiInpainter ci;
-        ci.setSourceImage(image.getMat());
+        ci.setSourceImage(img);
         ci.setSourceMask(sourceMask.getMat());
         ci.setTargetMask(targetMask.getMat());
         ci.setPatchSize(patchSize);
         ci.initialize();
-        
-        while (ci.hasMoreSteps()) {
-            ci.step();
-        }
 
-        ci.image().copyTo(image.getMat());
+        const bool complete = ci.run(timeBudget, cancel, observer);
+        ci.image().copyTo(img);
+
+        return complete;
     }
 }
@@ -0,0 +1,66 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <inpaint/criminisi_video.h>
+#include <opencv2/opencv.hpp>
+
+namespace Inpaint {
+
+    CriminisiVideoInpainter::CriminisiVideoInpainter()
+        : _searchRadius(-1)
+    {}
+
+    CriminisiInpainter &CriminisiVideoInpainter::inpainter()
+    {
+        return _inpainter;
+    }
+
+    void CriminisiVideoInpainter::setSearchRadius(int radius)
+    {
+        _searchRadius = radius;
+    }
+
+    void CriminisiVideoInpainter::process(cv::Mat &frame, const cv::Mat &targetMask, const cv::Mat &sourceMask)
+    {
+        // Offsets of a frame of different size are meaningless.
+        if (_previousOffsets.size() != frame.size())
+            _previousOffsets.release();
+
+        _inpainter.setSourceImage(frame);
+        _inpainter.setTargetMask(targetMask);
+        _inpainter.setSourceMask(sourceMask);
+        _inpainter.setOffsetPrior(_previousOffsets);
+        _inpainter.setPriorSearchRadius(_previousOffsets.empty() ? -1 : _searchRadius);
+        _inpainter.initialize();
+
+        while (_inpainter.hasMoreSteps()) {
+            _inpainter.step();
+        }
+
+        _inpainter.image().copyTo(frame);
+        _inpainter.sourceOffsets().copyTo(_previousOffsets);
+    }
+
+    void CriminisiVideoInpainter::reset()
+    {
+        _previousOffsets.release();
+    }
+
+}
@@ -0,0 +1,276 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <inpaint/patch_distance.h>
+#include <opencv2/opencv.hpp>
+#include <cstdlib>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define INPAINT_USE_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define INPAINT_USE_SSE2
+#endif
+
+namespace Inpaint {
+
+    /** Sum of absolute differences of a single row. Template bytes are expected to be pre-masked. */
+    inline int l1Row(const uchar *t, const uchar *m, const uchar *s, int n)
+    {
+        int i = 0;
+        int sum = 0;
+
+#ifdef INPAINT_USE_AVX2
+        __m256i acc256 = _mm256_setzero_si256();
+        for (; i + 32 <= n; i += 32) {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t + i));
+            const __m256i b = _mm256_and_si256(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(m + i)));
+            acc256 = _mm256_add_epi64(acc256, _mm256_sad_epu8(a, b));
+        }
+        const __m128i acc256Folded = _mm_add_epi64(_mm256_castsi256_si128(acc256), _mm256_extracti128_si256(acc256, 1));
+        sum += _mm_cvtsi128_si32(acc256Folded) + _mm_cvtsi128_si32(_mm_srli_si128(acc256Folded, 8));
+#endif
+
+#ifdef INPAINT_USE_SSE2
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 16 <= n; i += 16) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t + i));
+            const __m128i b = _mm_and_si128(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(m + i)));
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(a, b));
+        }
+        sum += _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+
+        for (; i < n; ++i) {
+            sum += std::abs(int(t[i]) - int(s[i] & m[i]));
+        }
+
+        return sum;
+    }
+
+    /** Sum of squared differences of a single row. Template bytes are expected to be pre-masked. */
+    inline int ssdRow(const uchar *t, const uchar *m, const uchar *s, int n)
+    {
+        int i = 0;
+        int sum = 0;
+
+#ifdef INPAINT_USE_AVX2
+        const __m256i zero256 = _mm256_setzero_si256();
+        __m256i acc256 = _mm256_setzero_si256();
+        for (; i + 32 <= n; i += 32) {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t + i));
+            const __m256i b = _mm256_and_si256(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(m + i)));
+            const __m256i dlo = _mm256_sub_epi16(_mm256_unpacklo_epi8(a, zero256), _mm256_unpacklo_epi8(b, zero256));
+            const __m256i dhi = _mm256_sub_epi16(_mm256_unpackhi_epi8(a, zero256), _mm256_unpackhi_epi8(b, zero256));
+            acc256 = _mm256_add_epi32(acc256, _mm256_madd_epi16(dlo, dlo));
+            acc256 = _mm256_add_epi32(acc256, _mm256_madd_epi16(dhi, dhi));
+        }
+        __m128i acc256Folded = _mm_add_epi32(_mm256_castsi256_si128(acc256), _mm256_extracti128_si256(acc256, 1));
+        acc256Folded = _mm_add_epi32(acc256Folded, _mm_srli_si128(acc256Folded, 8));
+        acc256Folded = _mm_add_epi32(acc256Folded, _mm_srli_si128(acc256Folded, 4));
+        sum += _mm_cvtsi128_si32(acc256Folded);
+#endif
+
+#ifdef INPAINT_USE_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 16 <= n; i += 16) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t + i));
+            const __m128i b = _mm_and_si128(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(m + i)));
+            const __m128i dlo = _mm_sub_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            const __m128i dhi = _mm_sub_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(dlo, dlo));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(dhi, dhi));
+        }
+        acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 8));
+        acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 4));
+        sum += _mm_cvtsi128_si32(acc);
+#endif
+
+        for (; i < n; ++i) {
+            const int d = int(t[i]) - int(s[i] & m[i]);
+            sum += d * d;
+        }
+
+        return sum;
+    }
+
+    /** Sum of absolute differences of a single row of 16-bit values. Template values are expected to be pre-masked. */
+    inline int64 l1Row16(const ushort *t, const ushort *m, const ushort *s, int n)
+    {
+        int64 sum = 0;
+        for (int i = 0; i < n; ++i) {
+            sum += std::abs(int(t[i]) - int(s[i] & m[i]));
+        }
+        return sum;
+    }
+
+    /** Sum of squared differences of a single row of 16-bit values. Template values are expected to be pre-masked. */
+    inline int64 ssdRow16(const ushort *t, const ushort *m, const ushort *s, int n)
+    {
+        int64 sum = 0;
+        for (int i = 0; i < n; ++i) {
+            const int64 d = int64(t[i]) - int64(s[i] & m[i]);
+            sum += d * d;
+        }
+        return sum;
+    }
+
+    /** Accumulate row distances of an image of the given element type until the bound is exceeded. */
+    template<class T, int64 (*Row)(const T*, const T*, const T*, int)>
+    inline int64 accumulateRows(const uchar *t, const uchar *m, const uchar *patch, size_t step, int rows, int rowStride, int n, int64 bound)
+    {
+        int64 sum = 0;
+        for (int y = 0; y < rows; ++y, t += rowStride, m += rowStride, patch += step) {
+            sum += Row(reinterpret_cast<const T*>(t), reinterpret_cast<const T*>(m), reinterpret_cast<const T*>(patch), n);
+            if (sum > bound)
+                break;
+        }
+        return sum;
+    }
+
+    /** Accumulate row distances of an 8-bit image. Positive Rows and N fix the row count and row length at compile time. */
+    template<int (*Row)(const uchar*, const uchar*, const uchar*, int), int Rows, int N>
+    int64 accumulateRows8(const uchar *t, const uchar *m, const uchar *patch, size_t step, int rows, int rowStride, int n, int64 bound)
+    {
+        const int r = Rows > 0 ? Rows : rows;
+        const int e = N > 0 ? N : n;
+
+        int64 sum = 0;
+        for (int y = 0; y < r; ++y, t += rowStride, m += rowStride, patch += step) {
+            sum += Row(t, m, patch, e);
+            if (sum > bound)
+                break;
+        }
+        return sum;
+    }
+
+    /** Select an 8-bit kernel specialized for square templates with half size H or smaller, down to 2. */
+    template<int (*Row)(const uchar*, const uchar*, const uchar*, int), int H>
+    struct FixedSizeKernel8 {
+        static MaskedPatchDistance::Kernel select(int rows, int n)
+        {
+            const int side = 2 * H + 1;
+            if (rows == side && n == side)
+                return &accumulateRows8<Row, side, side>;
+            if (rows == side && n == 3 * side)
+                return &accumulateRows8<Row, side, 3 * side>;
+            return FixedSizeKernel8<Row, H - 1>::select(rows, n);
+        }
+    };
+
+    template<int (*Row)(const uchar*, const uchar*, const uchar*, int)>
+    struct FixedSizeKernel8<Row, 1> {
+        static MaskedPatchDistance::Kernel select(int /*rows*/, int /*n*/)
+        {
+            return &accumulateRows8<Row, 0, 0>;
+        }
+    };
+
+    /** Copy rows of a template of the given element type pre-masked, along with the mask expanded to all channels. */
+    template<class T>
+    void expandTemplate(const cv::Mat &templ, const cv::Mat &mask, uchar *templBuffer, uchar *maskBuffer, int rowStride)
+    {
+        const int cn = templ.channels();
+        for (int y = 0; y < templ.rows; ++y) {
+            const T *tRow = templ.ptr<T>(y);
+            const uchar *mRow = mask.empty() ? 0 : mask.ptr<uchar>(y);
+            T *ot = reinterpret_cast<T*>(templBuffer + y * rowStride);
+            T *om = reinterpret_cast<T*>(maskBuffer + y * rowStride);
+
+            for (int x = 0; x < templ.cols; ++x) {
+                const T m = (!mRow || mRow[x]) ? T(~T(0)) : T(0);
+                for (int c = 0; c < cn; ++c) {
+                    om[x * cn + c] = m;
+                    ot[x * cn + c] = tRow[x * cn + c] & m;
+                }
+            }
+        }
+    }
+
+    MaskedPatchDistance::MaskedPatchDistance()
+        : _rows(0), _rowElements(0), _rowStride(0), _normType(cv::NORM_L1), _depth(CV_8U), _fixedSizeKernels(true)
+    {
+        selectKernel();
+    }
+
+    void MaskedPatchDistance::setNormType(int normType)
+    {
+        CV_Assert(normType == cv::NORM_L1 || normType == cv::NORM_L2SQR);
+        _normType = normType;
+        selectKernel();
+    }
+
+    void MaskedPatchDistance::setFixedSizeKernels(bool enable)
+    {
+        _fixedSizeKernels = enable;
+        selectKernel();
+    }
+
+    void MaskedPatchDistance::setTemplate(const cv::Mat &templ, const cv::Mat &mask)
+    {
+        CV_Assert(templ.depth() == CV_8U || templ.depth() == CV_16U);
+        CV_Assert(mask.empty() || (mask.type() == CV_8UC1 && mask.size() == templ.size()));
+
+        const int cn = templ.channels();
+
+        _depth = templ.depth();
+        _rows = templ.rows;
+        _rowElements = templ.cols * cn;
+        _rowStride = (_rowElements * (int)templ.elemSize1() + 31) & ~31;
+
+        // Expand the mask to all bits of all channels, and store the template pre-masked so
+        // that masking during evaluation reduces to a single AND on the patch values.
+        _templ.assign(_rows * _rowStride, 0);
+        _mask.assign(_rows * _rowStride, 0);
+
+        if (_depth == CV_8U) {
+            expandTemplate<uchar>(templ, mask, &_templ[0], &_mask[0], _rowStride);
+        } else {
+            expandTemplate<ushort>(templ, mask, &_templ[0], &_mask[0], _rowStride);
+        }
+
+        selectKernel();
+    }
+
+    void MaskedPatchDistance::selectKernel()
+    {
+        if (_depth == CV_16U) {
+            _kernel = _normType == cv::NORM_L1 ? &accumulateRows<ushort, l1Row16> : &accumulateRows<ushort, ssdRow16>;
+        } else if (!_fixedSizeKernels) {
+            _kernel = _normType == cv::NORM_L1 ? &accumulateRows8<l1Row, 0, 0> : &accumulateRows8<ssdRow, 0, 0>;
+        } else if (_normType == cv::NORM_L1) {
+            _kernel = FixedSizeKernel8<l1Row, 6>::select(_rows, _rowElements);
+        } else {
+            _kernel = FixedSizeKernel8<ssdRow, 6>::select(_rows, _rowElements);
+        }
+    }
+
+}
@@ -0,0 +1,135 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <inpaint/patch_projections.h>
+#include <opencv2/opencv.hpp>
+
+namespace Inpaint {
+
+    PatchProjections::PatchProjections()
+        : _cols(0), _channels(0), _dims(0), _partitions(3), _halfPatchSize(0)
+    {}
+
+    void PatchProjections::setPartitionSize(int n)
+    {
+        _partitions = n;
+    }
+
+    bool PatchProjections::empty() const
+    {
+        return _sums.empty();
+    }
+
+    void PatchProjections::clear()
+    {
+        _sums.clear();
+    }
+
+    int PatchProjections::partitionsForSize(int size) const
+    {
+        // Blocks of at most 16x16 pixels keep 8-bit sums within 16 bits.
+        return std::min(std::max(_partitions, (size + 15) / 16), size);
+    }
+
+    void PatchProjections::reserve(cv::Size size, int channels, int halfPatchSize)
+    {
+        const int partitions = partitionsForSize(2 * halfPatchSize + 1);
+        _sums.reserve(static_cast<size_t>(size.area()) * partitions * partitions * channels);
+        _integral.create(size.height + 1, size.width + 1, CV_32SC(channels));
+    }
+
+    void PatchProjections::build(const cv::Mat &image, const cv::Mat &mask, int halfPatchSize)
+    {
+        CV_Assert(image.type() == CV_8UC1 || image.type() == CV_8UC3);
+        CV_Assert(mask.type() == CV_8UC1 && mask.size() == image.size());
+
+        const int size = 2 * halfPatchSize + 1;
+        CV_Assert(_partitions > 0);
+        const int partitions = partitionsForSize(size);
+
+        _halfPatchSize = halfPatchSize;
+        _cols = image.cols;
+        _channels = image.channels();
+
+        _blocks.clear();
+        _areas.clear();
+        for (int by = 0; by < partitions; ++by) {
+            for (int bx = 0; bx < partitions; ++bx) {
+                const int x0 = (size * bx) / partitions;
+                const int y0 = (size * by) / partitions;
+                const int x1 = (size * (bx + 1)) / partitions;
+                const int y1 = (size * (by + 1)) / partitions;
+                _blocks.push_back(cv::Rect(x0, y0, x1 - x0, y1 - y0));
+                _areas.push_back((x1 - x0) * (y1 - y0));
+            }
+        }
+
+        _dims = static_cast<int>(_blocks.size()) * _channels;
+        _sums.assign(static_cast<size_t>(image.rows) * image.cols * _dims, 0);
+
+        cv::integral(image, _integral, CV_32S);
+
+        for (int y = 0; y < image.rows; ++y) {
+            const uchar *mRow = mask.ptr(y);
+            for (int x = 0; x < image.cols; ++x) {
+                if (!mRow[x])
+                    continue;
+
+                ushort *s = &_sums[(static_cast<size_t>(y) * _cols + x) * _dims];
+                for (size_t b = 0; b < _blocks.size(); ++b) {
+                    const cv::Rect &r = _blocks[b];
+                    const int x0 = x - halfPatchSize + r.x;
+                    const int y0 = y - halfPatchSize + r.y;
+
+                    const int *tRow = _integral.ptr<int>(y0);
+                    const int *bRow = _integral.ptr<int>(y0 + r.height);
+                    for (int c = 0; c < _channels; ++c) {
+                        const int l = x0 * _channels + c;
+                        const int rr = (x0 + r.width) * _channels + c;
+                        s[b * _channels + c] = static_cast<ushort>(bRow[rr] - bRow[l] - tRow[rr] + tRow[l]);
+                    }
+                }
+            }
+        }
+    }
+
+    void PatchProjections::project(const cv::Mat &templ, const cv::Mat &templMask, int normType, Template &t) const
+    {
+        const int size = 2 * _halfPatchSize + 1;
+        CV_Assert(templ.rows == size && templ.cols == size && templ.channels() == _channels && templ.depth() == CV_8U);
+        CV_Assert(templMask.empty() || (templMask.type() == CV_8UC1 && templMask.size() == templ.size()));
+        CV_Assert(normType == cv::NORM_L1 || normType == cv::NORM_L2SQR);
+
+        t.normType = normType;
+        t.blocks.clear();
+        t.sums.clear();
+
+        for (size_t b = 0; b < _blocks.size(); ++b) {
+            const cv::Rect &r = _blocks[b];
+            if (!templMask.empty() && cv::countNonZero(templMask(r)) != r.area())
+                continue;
+
+            const cv::Scalar s = cv::sum(templ(r));
+            t.blocks.push_back(static_cast<int>(b));
+            for (int c = 0; c < _channels; ++c)
+                t.sums.push_back(static_cast<int>(s[c]));
+        }
+    }
+
+}
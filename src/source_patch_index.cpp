@@ -0,0 +1,314 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <inpaint/source_patch_index.h>
+#include <inpaint/integral.h>
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+namespace Inpaint {
+
+    const int LEAF_SIZE = 8;
+
+    SourcePatchIndex::Workspace::Workspace()
+        : stamp(0)
+    {}
+
+    SourcePatchIndex::SourcePatchIndex()
+        : _dims(0), _channels(0), _nTrees(4), _partitions(4), _halfPatchSize(0)
+    {}
+
+    void SourcePatchIndex::setTrees(int n)
+    {
+        _nTrees = n;
+    }
+
+    void SourcePatchIndex::setPartitionSize(int n)
+    {
+        _partitions = n;
+    }
+
+    bool SourcePatchIndex::empty() const
+    {
+        return _centers.empty();
+    }
+
+    void SourcePatchIndex::build(const cv::Mat &image, const std::vector<cv::Point> &centers, int halfPatchSize)
+    {
+        CV_Assert(image.type() == CV_8UC1 || image.type() == CV_8UC3);
+        CV_Assert(_nTrees > 0);
+        CV_Assert(_partitions > 0);
+
+        // Small patches cannot be split into more blocks than pixels per side.
+        const int size = 2 * halfPatchSize + 1;
+        const int partitions = std::min(_partitions, size);
+
+        _halfPatchSize = halfPatchSize;
+        _channels = image.channels();
+        _centers = centers;
+
+        // Blocks subdivide the patch as evenly as possible.
+        _blocks.clear();
+        for (int by = 0; by < partitions; ++by) {
+            for (int bx = 0; bx < partitions; ++bx) {
+                const int x0 = (size * bx) / partitions;
+                const int y0 = (size * by) / partitions;
+                const int x1 = (size * (bx + 1)) / partitions;
+                const int y1 = (size * (by + 1)) / partitions;
+                _blocks.push_back(cv::Rect(x0, y0, x1 - x0, y1 - y0));
+            }
+        }
+
+        _dims = static_cast<int>(_blocks.size()) * _channels;
+
+        // Block means of all patches via an integral image. Means are stored rounded, which keeps
+        // the index at a quarter of the size of float descriptors.
+        cv::Mat integral;
+        cv::integral(image, integral, CV_32S);
+
+        const int n = static_cast<int>(_centers.size());
+        _descriptors.resize(static_cast<size_t>(n) * _dims);
+
+        for (int i = 0; i < n; ++i) {
+            const cv::Point tl(_centers[i].x - halfPatchSize, _centers[i].y - halfPatchSize);
+            uchar *d = &_descriptors[static_cast<size_t>(i) * _dims];
+
+            for (size_t b = 0; b < _blocks.size(); ++b) {
+                const cv::Rect r = _blocks[b] + tl;
+                const cv::Scalar s = sumInRectUsingIntegralImage(integral, r);
+                for (int c = 0; c < _channels; ++c)
+                    d[b * _channels + c] = cv::saturate_cast<uchar>(s[c] / r.area());
+            }
+        }
+
+        // Build trees.
+        cv::RNG rng(0x5eed);
+        _trees.assign(_nTrees, std::vector<Node>());
+        _treeIndices.assign(_nTrees, std::vector<int>());
+
+        for (int t = 0; t < _nTrees && n > 0; ++t) {
+            std::vector<int> &indices = _treeIndices[t];
+            indices.resize(n);
+            for (int i = 0; i < n; ++i)
+                indices[i] = i;
+
+            buildNode(_trees[t], indices, 0, n, rng);
+        }
+    }
+
+    int SourcePatchIndex::buildNode(std::vector<Node> &nodes, std::vector<int> &indices, int begin, int end, cv::RNG &rng)
+    {
+        const int nodeIndex = static_cast<int>(nodes.size());
+        nodes.push_back(Node());
+
+        Node leaf;
+        leaf.dim = -1;
+        leaf.split = 0;
+        leaf.left = begin;
+        leaf.right = end;
+
+        if (end - begin <= LEAF_SIZE) {
+            nodes[nodeIndex] = leaf;
+            return nodeIndex;
+        }
+
+        // Estimate mean and variance per dimension from a subset of the range.
+        const int nSamples = std::min(end - begin, 100);
+        std::vector<double> mean(_dims, 0.0), var(_dims, 0.0);
+
+        for (int i = 0; i < nSamples; ++i) {
+            const uchar *d = &_descriptors[static_cast<size_t>(indices[begin + (i * (end - begin)) / nSamples]) * _dims];
+            for (int j = 0; j < _dims; ++j)
+                mean[j] += d[j];
+        }
+        for (int j = 0; j < _dims; ++j)
+            mean[j] /= nSamples;
+
+        for (int i = 0; i < nSamples; ++i) {
+            const uchar *d = &_descriptors[static_cast<size_t>(indices[begin + (i * (end - begin)) / nSamples]) * _dims];
+            for (int j = 0; j < _dims; ++j)
+                var[j] += (d[j] - mean[j]) * (d[j] - mean[j]);
+        }
+
+        // Randomize trees by picking one of the dimensions of highest variance.
+        std::vector< std::pair<double, int> > ranked(_dims);
+        for (int j = 0; j < _dims; ++j)
+            ranked[j] = std::make_pair(var[j], j);
+
+        const int nTop = std::min(_dims, 5);
+        std::partial_sort(ranked.begin(), ranked.begin() + nTop, ranked.end(), std::greater< std::pair<double, int> >());
+
+        const int dim = ranked[rng.uniform(0, nTop)].second;
+        const float split = static_cast<float>(mean[dim]);
+
+        // Partition indices around the split value.
+        int mid = begin;
+        for (int i = begin; i < end; ++i) {
+            if (_descriptors[static_cast<size_t>(indices[i]) * _dims + dim] < split)
+                std::swap(indices[i], indices[mid++]);
+        }
+
+        // All samples identical in this dimension. Keep them in a single leaf.
+        if (mid == begin || mid == end) {
+            nodes[nodeIndex] = leaf;
+            return nodeIndex;
+        }
+
+        const int left = buildNode(nodes, indices, begin, mid, rng);
+        const int right = buildNode(nodes, indices, mid, end, rng);
+
+        Node &node = nodes[nodeIndex];
+        node.dim = dim;
+        node.split = split;
+        node.left = left;
+        node.right = right;
+
+        return nodeIndex;
+    }
+
+    float SourcePatchIndex::distance(int i, const Workspace &ws) const
+    {
+        const uchar *d = &_descriptors[static_cast<size_t>(i) * _dims];
+        const float *q = &ws.query[0];
+        const uchar *valid = &ws.valid[0];
+
+        float sum = 0;
+        for (int j = 0; j < _dims; ++j) {
+            if (valid[j]) {
+                const float diff = d[j] - q[j];
+                sum += diff * diff;
+            }
+        }
+        return sum;
+    }
+
+    bool SourcePatchIndex::query(const cv::Mat &templ, const cv::Mat &templMask, int k, int maxChecks, std::vector<cv::Point> &neighbors, Workspace &ws) const
+    {
+        const int size = 2 * _halfPatchSize + 1;
+        CV_Assert(templ.rows == size && templ.cols == size && templ.channels() == _channels && templ.depth() == CV_8U);
+        CV_Assert(templMask.empty() || (templMask.type() == CV_8UC1 && templMask.size() == templ.size()));
+        CV_Assert(k > 0);
+
+        neighbors.clear();
+
+        // Describe the query like the indexed patches, keeping only blocks that are entirely known.
+        std::vector<float> &q = ws.query;
+        std::vector<uchar> &valid = ws.valid;
+        q.assign(_dims, 0.f);
+        valid.assign(_dims, 0);
+        bool anyValid = false;
+
+        for (size_t b = 0; b < _blocks.size(); ++b) {
+            const cv::Rect &r = _blocks[b];
+            if (!templMask.empty() && cv::countNonZero(templMask(r)) != r.area())
+                continue;
+
+            const cv::Scalar m = cv::mean(templ(r));
+            for (int c = 0; c < _channels; ++c) {
+                q[b * _channels + c] = cv::saturate_cast<uchar>(m[c]);
+                valid[b * _channels + c] = 1;
+            }
+            anyValid = true;
+        }
+
+        if (!anyValid || _centers.empty())
+            return false;
+
+        // Best-bin-first search over all trees. Branches are ordered by a lower bound of the
+        // distance accumulated along splits on valid dimensions.
+        // Branches form a min-heap on the bound.
+        const std::greater<Branch> later;
+        std::vector<Branch> &branches = ws.branches;
+        branches.clear();
+        for (int t = 0; t < static_cast<int>(_trees.size()); ++t)
+            branches.push_back(Branch(0.f, std::make_pair(t, 0)));
+        std::make_heap(branches.begin(), branches.end(), later);
+
+        // Current k best as max-heap on distance.
+        std::vector< std::pair<float, int> > &best = ws.best;
+        best.clear();
+
+        // Trees share points. A patch was compared already in this query if its stamp matches.
+        std::vector<unsigned> &seen = ws.seen;
+        if (seen.size() != _centers.size() || ++ws.stamp == 0) {
+            seen.assign(_centers.size(), 0);
+            ws.stamp = 1;
+        }
+        const unsigned stamp = ws.stamp;
+
+        int checks = 0;
+
+        while (!branches.empty() && checks < maxChecks) {
+            std::pop_heap(branches.begin(), branches.end(), later);
+            const Branch branch = branches.back();
+            branches.pop_back();
+
+            if (static_cast<int>(best.size()) == k && branch.first >= best.front().first)
+                continue;
+
+            const std::vector<Node> &nodes = _trees[branch.second.first];
+            const std::vector<int> &indices = _treeIndices[branch.second.first];
+            int n = branch.second.second;
+
+            while (nodes[n].dim >= 0) {
+                const Node &node = nodes[n];
+                if (!valid[node.dim]) {
+                    branches.push_back(Branch(branch.first, std::make_pair(branch.second.first, node.right)));
+                    std::push_heap(branches.begin(), branches.end(), later);
+                    n = node.left;
+                } else {
+                    const float diff = q[node.dim] - node.split;
+                    const int nearer = diff < 0 ? node.left : node.right;
+                    const int farther = diff < 0 ? node.right : node.left;
+                    branches.push_back(Branch(branch.first + diff * diff, std::make_pair(branch.second.first, farther)));
+                    std::push_heap(branches.begin(), branches.end(), later);
+                    n = nearer;
+                }
+            }
+
+            for (int i = nodes[n].left; i < nodes[n].right && checks < maxChecks; ++i) {
+                const int idx = indices[i];
+
+                if (seen[idx] == stamp)
+                    continue;
+                seen[idx] = stamp;
+
+                ++checks;
+                const float d = distance(idx, ws);
+                if (static_cast<int>(best.size()) < k) {
+                    best.push_back(std::make_pair(d, idx));
+                    std::push_heap(best.begin(), best.end());
+                } else if (d < best.front().first) {
+                    std::pop_heap(best.begin(), best.end());
+                    best.back() = std::make_pair(d, idx);
+                    std::push_heap(best.begin(), best.end());
+                }
+            }
+        }
+
+        std::sort_heap(best.begin(), best.end());
+        for (size_t i = 0; i < best.size(); ++i)
+            neighbors.push_back(_centers[best[i].second]);
+
+        return true;
+    }
+
+}
@@ -0,0 +1,122 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <inpaint/spectral_distance.h>
+#include <opencv2/opencv.hpp>
+
+namespace Inpaint {
+
+    SpectralPatchDistance::SpectralPatchDistance()
+        : _channels(0), _ready(false)
+    {}
+
+    void SpectralPatchDistance::setImage(const cv::Mat &image, cv::Size templSize)
+    {
+        CV_Assert(image.type() == CV_8UC1 || image.type() == CV_8UC3);
+        CV_Assert(templSize.width <= image.cols && templSize.height <= image.rows);
+
+        _imageSize = image.size();
+        _templSize = templSize;
+        _channels = image.channels();
+
+        // Circular correlation only wraps around for positions where the template does not fit into
+        // the image, so padding to the image size is sufficient.
+        _dftSize = cv::Size(cv::getOptimalDFTSize(image.cols), cv::getOptimalDFTSize(image.rows));
+
+        cv::split(image, _channelPlanes);
+
+        _squares.create(_dftSize, CV_64FC1);
+        _squares.setTo(0);
+        cv::Mat squaresRoi = _squares(cv::Rect(0, 0, image.cols, image.rows));
+
+        _padded.create(_dftSize, CV_64FC1);
+        cv::Mat paddedRoi = _padded(cv::Rect(0, 0, image.cols, image.rows));
+
+        _spectra.resize(_channels + 1);
+        for (int c = 0; c < _channels; ++c) {
+            _padded.setTo(0);
+            _channelPlanes[c].convertTo(paddedRoi, CV_64F);
+
+            cv::accumulateSquare(paddedRoi, squaresRoi);
+            cv::dft(_padded, _spectra[c], 0, image.rows);
+        }
+        cv::dft(_squares, _spectra[_channels], 0, image.rows);
+
+        _ready = true;
+    }
+
+    bool SpectralPatchDistance::empty() const
+    {
+        return !_ready;
+    }
+
+    void SpectralPatchDistance::clear()
+    {
+        _ready = false;
+    }
+
+    cv::Size SpectralPatchDistance::transformSize() const
+    {
+        return _dftSize;
+    }
+
+    void SpectralPatchDistance::compute(const cv::Mat &templ, const cv::Mat &mask, cv::Mat_<double> &distances, Workspace &ws) const
+    {
+        CV_Assert(!empty());
+        CV_Assert(templ.size() == _templSize && templ.channels() == _channels && templ.depth() == CV_8U);
+        CV_Assert(mask.type() == CV_8UC1 && mask.size() == _templSize);
+
+        const cv::Rect templRect(0, 0, _templSize.width, _templSize.height);
+
+        std::vector<cv::Mat> channels;
+        cv::split(templ, channels);
+
+        cv::Mat m;
+        cv::Mat(mask != 0).convertTo(m, CV_64F, 1.0 / 255.0);
+
+        ws.kernel.create(_dftSize, CV_64FC1);
+
+        // Correlation with the squared image: sum m * s^2
+        ws.kernel.setTo(0);
+        m.copyTo(ws.kernel(templRect));
+        cv::dft(ws.kernel, ws.kernelSpectrum, 0, _templSize.height);
+        cv::mulSpectrums(_spectra[_channels], ws.kernelSpectrum, ws.accum, 0, true);
+
+        // Cross correlation: -2 * sum m * t * s
+        double templSquares = 0;
+        for (int c = 0; c < _channels; ++c) {
+            cv::Mat mt;
+            channels[c].convertTo(mt, CV_64F);
+            mt = mt.mul(m);
+            templSquares += mt.dot(mt);
+
+            ws.kernel.setTo(0);
+            mt.copyTo(ws.kernel(templRect));
+            cv::dft(ws.kernel, ws.kernelSpectrum, 0, _templSize.height);
+            cv::mulSpectrums(_spectra[c], ws.kernelSpectrum, ws.product, 0, true);
+            cv::scaleAdd(ws.product, -2.0, ws.accum, ws.accum);
+        }
+
+        cv::dft(ws.accum, ws.accum, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT);
+
+        const cv::Size valid(_imageSize.width - _templSize.width + 1, _imageSize.height - _templSize.height + 1);
+        ws.accum(cv::Rect(0, 0, valid.width, valid.height)).convertTo(distances, CV_64F, 1.0, templSquares);
+    }
+
+}
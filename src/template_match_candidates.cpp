@@ -45,19 +45,29 @@ namespace Inpaint {
 
     void TemplateMatchCandidates::initialize()
     {
-        std::vector< cv::Mat_<uchar> > imageChannels;
-        cv::split(_image, imageChannels);
-        const size_t nChannels = imageChannels.size();
+        // Channel and integral buffers are kept between calls and only reallocated on size changes.
+        cv::split(_image, _imageChannels);
+        const size_t nChannels = _imageChannels.size();
 
         _integrals.resize(nChannels);
         for (size_t i = 0; i < nChannels; ++i) {
-            cv::integral(imageChannels[i], _integrals[i]);
+            cv::integral(_imageChannels[i], _integrals[i]);
         }
         
         _blocks.clear();
         computeBlockRects(_templateSize, _partitionSize, _blocks);
     }
 
+    void TemplateMatchCandidates::reserve(cv::Size imageSize, int channels)
+    {
+        _imageChannels.resize(channels);
+        _integrals.resize(channels);
+        for (int i = 0; i < channels; ++i) {
+            _imageChannels[i].create(imageSize);
+            _integrals[i].create(imageSize.height + 1, imageSize.width + 1);
+        }
+    }
+
 
     void TemplateMatchCandidates::findCandidates(
             const cv::Mat &templ,
@@ -0,0 +1,98 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "catch.hpp"
+#include "random_testdata.h"
+
+#include <inpaint/criminisi_async.h>
+#include <opencv2/opencv.hpp>
+
+using namespace Inpaint;
+
+/** Cancels the inpainting from within its first progress report. */
+class CancelOnFirstStep : public ProgressObserver {
+public:
+    CancelOnFirstStep(CriminisiAsyncInpainter &a)
+        : calls(0), fraction(0.f), _a(a)
+    {}
+
+    void progress(float f)
+    {
+        if (calls++ == 0)
+            _a.cancel();
+        fraction = f;
+    }
+
+    int calls;
+    float fraction;
+
+private:
+    CriminisiAsyncInpainter &_a;
+};
+
+TEST_CASE("criminisi-async")
+{
+    cv::Mat img = randomLinesColorImage(100, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(40, 40, 20, 15));
+
+    cv::Mat expected = img.clone();
+    inpaintCriminisi(expected, mask, cv::Mat(), 9);
+
+    CriminisiAsyncInpainter a;
+    a.inpainter().setSourceImage(img);
+    a.inpainter().setTargetMask(mask);
+    a.start();
+
+    // Snapshots built from dirty regions only end up equal to the final result.
+    cv::Mat snapshot = img.clone();
+    cv::Mat target = mask.clone();
+    std::vector<cv::Rect> dirty;
+    int nDirty = 0;
+
+    bool finished = false;
+    while (!finished) {
+        finished = a.finished();
+        a.poll(snapshot, target, dirty);
+        nDirty += static_cast<int>(dirty.size());
+    }
+    a.wait();
+
+    REQUIRE(nDirty > 0);
+    REQUIRE(a.progress() == 1.f);
+    REQUIRE(cv::norm(snapshot, expected) == 0);
+    REQUIRE(cv::countNonZero(target) == 0);
+    REQUIRE(!a.poll(snapshot, target, dirty));
+
+    // Cancelled runs stop after the current step and can be restarted.
+    CancelOnFirstStep observer(a);
+    a.setObserver(&observer);
+    a.start();
+    a.wait();
+    REQUIRE(a.finished());
+    REQUIRE(observer.calls == 1);
+    REQUIRE(observer.fraction < 1.f);
+    REQUIRE(a.progress() == observer.fraction);
+    REQUIRE(cv::countNonZero(a.inpainter().targetRegion()) > 0);
+
+    a.setObserver(0);
+    a.start();
+    a.wait();
+    REQUIRE(cv::norm(a.inpainter().image(), expected) == 0);
+}
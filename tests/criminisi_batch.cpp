@@ -0,0 +1,109 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.hpp"
+#include "random_testdata.h"
+
+#include <inpaint/criminisi_batch.h>
+#include <opencv2/opencv.hpp>
+
+using namespace Inpaint;
+
+TEST_CASE("criminisi-batch-inpainter")
+{
+    std::vector<InpaintingJob> jobs;
+    std::vector<cv::Mat> expected;
+
+    const int sizes[] = {60, 80, 60, 100, 80};
+    for (int i = 0; i < 5; ++i) {
+        cv::Mat img = randomLinesColorImage(sizes[i], 10 + i);
+        cv::Mat mask = rectangleMask(img.size(), cv::Rect(20 + i, 25, 10 + 2 * i, 8));
+
+        cv::Mat e = img.clone();
+        inpaintCriminisi(e, mask, cv::Mat(), 9);
+        expected.push_back(e);
+
+        jobs.push_back(InpaintingJob(img, mask, cv::Mat(), 9));
+    }
+
+    // Workers are reused across batches.
+    CriminisiBatchInpainter b;
+    b.setWorkers(2);
+
+    std::vector<InpaintingJob> copies = jobs;
+    for (size_t i = 0; i < copies.size(); ++i) {
+        copies[i].image = jobs[i].image.clone();
+    }
+
+    b.run(jobs);
+    b.run(copies);
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        REQUIRE(cv::norm(jobs[i].image, expected[i]) == 0);
+        REQUIRE(cv::norm(copies[i].image, expected[i]) == 0);
+    }
+}
+
+TEST_CASE("criminisi-batch-invalid-job")
+{
+    cv::Mat img = randomLinesImage(60, 10);
+    cv::Mat mask(30, 30, CV_8UC1);
+    mask.setTo(255);
+
+    // Invalid jobs are rejected before any worker starts.
+    std::vector<InpaintingJob> jobs;
+    jobs.push_back(InpaintingJob(img, mask, cv::Mat(), 9));
+
+    CriminisiBatchInpainter b;
+    REQUIRE_THROWS_AS(b.run(jobs), const cv::Exception &);
+}
+
+TEST_CASE("criminisi-batch-invalid-job-parameters")
+{
+    cv::Mat img = randomLinesImage(60, 10);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(20, 25, 10, 8));
+    cv::Mat original = img.clone();
+
+    CriminisiBatchInpainter b;
+    b.setWorkers(2);
+
+    // A bad job fails the whole batch before the valid job is touched.
+    SECTION("patch-size")
+    {
+        std::vector<InpaintingJob> jobs;
+        jobs.push_back(InpaintingJob(img, mask, cv::Mat(), 9));
+        jobs.push_back(InpaintingJob(img.clone(), mask, cv::Mat(), 0));
+
+        REQUIRE_THROWS_AS(b.run(jobs), const cv::Exception &);
+        REQUIRE(cv::norm(img, original) == 0);
+    }
+
+    SECTION("image-type")
+    {
+        cv::Mat wide(img.size(), CV_64FC1);
+        wide.setTo(0);
+
+        std::vector<InpaintingJob> jobs;
+        jobs.push_back(InpaintingJob(img, mask, cv::Mat(), 9));
+        jobs.push_back(InpaintingJob(wide, mask, cv::Mat(), 9));
+
+        REQUIRE_THROWS_AS(b.run(jobs), const cv::Exception &);
+        REQUIRE(cv::norm(img, original) == 0);
+    }
+}
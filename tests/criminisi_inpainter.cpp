@@ -25,6 +25,23 @@
 
 using namespace Inpaint;
 
+/** Perform all remaining steps. */
+static void inpaintAll(CriminisiInpainter &ci)
+{
+    while (ci.hasMoreSteps()) {
+        ci.step();
+    }
+}
+
+/** Number of pixels outside the target mask that differ between two color images. */
+static int changedKnownPixels(const cv::Mat &a, const cv::Mat &b, const cv::Mat &mask)
+{
+    cv::Mat diff;
+    cv::absdiff(a, b, diff);
+    cv::cvtColor(diff, diff, cv::COLOR_BGR2GRAY);
+    return cv::countNonZero(diff & (mask == 0));
+}
+
 TEST_CASE("criminisi")
 {
     cv::Mat img = uniformRandomNoiseImage(50);
@@ -41,3 +58,629 @@ TEST_CASE("criminisi")
     REQUIRE(img.size() == inpainter.image().size());
     REQUIRE(cv::norm(img, inpainter.image()) == 0);
 }
+
+TEST_CASE("criminisi-fill")
+{
+    cv::Mat img = randomLinesColorImage(80, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(30, 30, 15, 10));
+
+    CriminisiInpainter inpainter;
+    inpainter.setSourceImage(img);
+    inpainter.setTargetMask(mask);
+    inpainter.setPatchSize(9);
+    inpainter.initialize();
+
+    REQUIRE(inpainter.hasMoreSteps());
+
+    int steps = 0;
+    while (inpainter.hasMoreSteps()) {
+        inpainter.step();
+        ++steps;
+    }
+
+    REQUIRE(steps > 1);
+    REQUIRE(cv::countNonZero(inpainter.targetRegion()) == 0);
+
+    // Known pixels are never touched.
+    REQUIRE(changedKnownPixels(img, inpainter.image(), mask) == 0);
+}
+
+TEST_CASE("criminisi-parallel-search")
+{
+    cv::Mat img = randomLinesColorImage(80, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(30, 30, 15, 10));
+
+    cv::Mat results[2];
+    const int threads[2] = {1, 4};
+
+    for (int i = 0; i < 2; ++i) {
+        CriminisiInpainter inpainter;
+        inpainter.setSourceImage(img);
+        inpainter.setTargetMask(mask);
+        inpainter.setPatchSize(9);
+        inpainter.setSearchThreads(threads[i]);
+        inpainter.initialize();
+
+        inpaintAll(inpainter);
+
+        results[i] = inpainter.image().clone();
+    }
+
+    REQUIRE(cv::norm(results[0], results[1]) == 0);
+}
+
+TEST_CASE("criminisi-pyramid")
+{
+    cv::Mat img = randomLinesColorImage(80, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(30, 30, 15, 10));
+
+    CriminisiInpainter inpainter;
+    inpainter.setSourceImage(img);
+    inpainter.setTargetMask(mask);
+    inpainter.setPatchSize(9);
+    inpainter.setPyramidLevels(2);
+    inpainter.initialize();
+
+    inpaintAll(inpainter);
+
+    REQUIRE(cv::countNonZero(inpainter.targetRegion()) == 0);
+
+    // Every inpainted pixel records where it was copied from, which is a known pixel.
+    cv::Mat_<cv::Vec2i> offsets = inpainter.sourceOffsets();
+    for (int y = 0; y < mask.rows; ++y) {
+        for (int x = 0; x < mask.cols; ++x) {
+            if (!mask.at<uchar>(y, x))
+                continue;
+            const cv::Vec2i o = offsets(y, x);
+            REQUIRE((o[0] != 0 || o[1] != 0));
+            REQUIRE(mask.at<uchar>(y + o[1], x + o[0]) == 0);
+        }
+    }
+}
+
+TEST_CASE("criminisi-batch")
+{
+    cv::Mat img = randomLinesColorImage(120, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(30, 30, 60, 40));
+
+    int steps[2] = {0, 0};
+    const int batchSizes[2] = {1, 4};
+
+    for (int i = 0; i < 2; ++i) {
+        CriminisiInpainter inpainter;
+        inpainter.setSourceImage(img);
+        inpainter.setTargetMask(mask);
+        inpainter.setPatchSize(9);
+        inpainter.setBatchSize(batchSizes[i]);
+        inpainter.initialize();
+
+        while (inpainter.hasMoreSteps()) {
+            inpainter.step();
+            ++steps[i];
+        }
+
+        REQUIRE(cv::countNonZero(inpainter.targetRegion()) == 0);
+
+        REQUIRE(changedKnownPixels(img, inpainter.image(), mask) == 0);
+    }
+
+    REQUIRE(steps[1] < steps[0]);
+}
+
+TEST_CASE("criminisi-patchmatch")
+{
+    cv::Mat img = randomLinesColorImage(120, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(30, 30, 40, 30));
+
+    CriminisiInpainter inpainter;
+    inpainter.setSourceImage(img);
+    inpainter.setTargetMask(mask);
+    inpainter.setPatchSize(9);
+    inpainter.setSourceSearch(CriminisiInpainter::SOURCE_SEARCH_PATCHMATCH);
+    inpainter.initialize();
+
+    inpaintAll(inpainter);
+
+    REQUIRE(cv::countNonZero(inpainter.targetRegion()) == 0);
+
+    REQUIRE(changedKnownPixels(img, inpainter.image(), mask) == 0);
+
+    cv::Mat_<cv::Vec2i> offsets = inpainter.sourceOffsets();
+    for (int y = 0; y < mask.rows; ++y) {
+        for (int x = 0; x < mask.cols; ++x) {
+            if (mask.at<uchar>(y, x)) {
+                const cv::Vec2i o = offsets(y, x);
+                REQUIRE(mask.at<uchar>(y + o[1], x + o[0]) == 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("criminisi-index")
+{
+    cv::Mat img = randomLinesColorImage(120, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(30, 30, 40, 30));
+
+    CriminisiInpainter inpainter;
+    inpainter.setSourceImage(img);
+    inpainter.setTargetMask(mask);
+    inpainter.setPatchSize(9);
+    inpainter.setSourceSearch(CriminisiInpainter::SOURCE_SEARCH_INDEX);
+    inpainter.initialize();
+
+    inpaintAll(inpainter);
+
+    REQUIRE(cv::countNonZero(inpainter.targetRegion()) == 0);
+
+    REQUIRE(changedKnownPixels(img, inpainter.image(), mask) == 0);
+}
+
+TEST_CASE("criminisi-spectral-search")
+{
+    cv::Mat img = randomLinesColorImage(80, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(30, 30, 15, 10));
+
+    cv::Mat results[2];
+    const int modes[2] = {CriminisiInpainter::SPECTRAL_SEARCH_NEVER, CriminisiInpainter::SPECTRAL_SEARCH_ALWAYS};
+
+    for (int i = 0; i < 2; ++i) {
+        CriminisiInpainter inpainter;
+        inpainter.setSourceImage(img);
+        inpainter.setTargetMask(mask);
+        inpainter.setPatchSize(13);
+        inpainter.setNormType(cv::NORM_L2SQR);
+        inpainter.setSpectralSearch(modes[i]);
+        inpainter.initialize();
+
+        inpaintAll(inpainter);
+
+        results[i] = inpainter.image().clone();
+    }
+
+    REQUIRE(cv::norm(results[0], results[1]) == 0);
+}
+
+TEST_CASE("criminisi-local-search")
+{
+    cv::Mat img = randomLinesColorImage(120, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(50, 50, 15, 10));
+
+    CriminisiInpainter inpainter;
+    inpainter.setSourceImage(img);
+    inpainter.setTargetMask(mask);
+    inpainter.setPatchSize(9);
+    inpainter.setSearchRadius(10);
+    inpainter.setSearchErrorThreshold(1e9f);
+    inpainter.initialize();
+
+    inpaintAll(inpainter);
+
+    REQUIRE(cv::countNonZero(inpainter.targetRegion()) == 0);
+
+    // Any match is accepted, so sources are taken from the first window holding one.
+    cv::Mat_<cv::Vec2i> offsets = inpainter.sourceOffsets();
+    for (int y = 0; y < mask.rows; ++y) {
+        for (int x = 0; x < mask.cols; ++x) {
+            if (mask.at<uchar>(y, x)) {
+                const cv::Vec2i o = offsets(y, x);
+                REQUIRE(std::abs(o[0]) <= 20);
+                REQUIRE(std::abs(o[1]) <= 20);
+            }
+        }
+    }
+}
+
+TEST_CASE("criminisi-roi")
+{
+    cv::Mat img = randomLinesColorImage(160, 40);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(100, 40, 15, 10));
+
+    const cv::Rect roi = inpaintingRegionOfInterest(mask, 20, 9);
+    REQUIRE(roi == cv::Rect(100 - 31, 40 - 31, 15 + 62, 10 + 62));
+    REQUIRE(inpaintingRegionOfInterest(cv::Mat::zeros(img.size(), CV_8UC1), 20, 9).area() == 0);
+
+    // Same as inpainting the crop by hand.
+    CriminisiInpainter ci;
+    ci.setSourceImage(img(roi).clone());
+    ci.setTargetMask(mask(roi).clone());
+    ci.setPatchSize(9);
+    ci.initialize();
+    inpaintAll(ci);
+
+    cv::Mat result = img.clone();
+    inpaintCriminisi(result, mask, cv::Mat(), 9, 1, 20);
+
+    REQUIRE(cv::norm(result(roi), ci.image()) == 0);
+
+    // Nothing outside the target is touched.
+    REQUIRE(changedKnownPixels(img, result, mask) == 0);
+}
+
+TEST_CASE("criminisi-components")
+{
+    cv::Mat img = randomLinesColorImage(200, 40);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(20, 20, 10, 10));
+    cv::rectangle(mask, cv::Rect(150, 150, 10, 10), cv::Scalar(255), -1);
+    // Two close blemishes that share their context.
+    cv::rectangle(mask, cv::Rect(150, 30, 8, 8), cv::Scalar(255), -1);
+    cv::rectangle(mask, cv::Rect(165, 30, 8, 8), cv::Scalar(255), -1);
+
+    std::vector<cv::Rect> regions;
+    inpaintingRegionsOfInterest(mask, 10, 9, regions);
+    REQUIRE(regions.size() == 3);
+
+    for (size_t i = 0; i < regions.size(); ++i) {
+        for (size_t j = i + 1; j < regions.size(); ++j) {
+            REQUIRE((regions[i] & regions[j]).area() == 0);
+        }
+    }
+
+    int covered = 0;
+    for (size_t i = 0; i < regions.size(); ++i) {
+        covered += cv::countNonZero(mask(regions[i]));
+    }
+    REQUIRE(covered == cv::countNonZero(mask));
+
+    // Concurrent inpainting gives the same result as inpainting regions one by one.
+    cv::Mat expected = img.clone();
+    for (size_t i = 0; i < regions.size(); ++i) {
+        cv::Mat crop = expected(regions[i]);
+        inpaintCriminisi(crop, mask(regions[i]), cv::Mat(), 9);
+    }
+
+    cv::Mat result = img.clone();
+    inpaintCriminisi(result, mask, cv::Mat(), 9, 1, 10);
+
+    REQUIRE(cv::norm(result, expected) == 0);
+}
+
+TEST_CASE("criminisi-reuse-buffers")
+{
+    cv::Mat img = randomLinesColorImage(80, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(30, 30, 15, 10));
+
+    CriminisiInpainter inpainter;
+    inpainter.reserve(img.size());
+    const uchar *data = inpainter.image().data;
+
+    cv::Mat results[2];
+    for (int i = 0; i < 2; ++i) {
+        inpainter.setSourceImage(img);
+        inpainter.setTargetMask(mask);
+        inpainter.initialize();
+
+        // Same sized images reuse reserved buffers.
+        REQUIRE(inpainter.image().data == data);
+
+        inpaintAll(inpainter);
+        results[i] = inpainter.image().clone();
+    }
+
+    REQUIRE(cv::norm(results[0], results[1]) == 0);
+
+    inpainter.shrink();
+    REQUIRE(inpainter.image().empty());
+    REQUIRE(!inpainter.hasMoreSteps());
+}
+
+TEST_CASE("criminisi-stats")
+{
+    cv::Mat img = randomLinesColorImage(80, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(10, 10, 12, 10));
+    cv::rectangle(mask, cv::Rect(55, 50, 12, 10), cv::Scalar(255), -1);
+
+    cv::Mat expected = img.clone();
+    inpaintCriminisi(expected, mask, cv::Mat(), 9, 1, 5);
+
+    // Profiling does not change results. Statistics of all regions are accumulated.
+    cv::Mat result = img.clone();
+    CriminisiStats stats;
+    inpaintCriminisi(result, mask, cv::Mat(), 9, 1, 5, &stats);
+    REQUIRE(cv::norm(result, expected) == 0);
+
+    REQUIRE(stats.steps > 0);
+    REQUIRE(stats.patches == stats.steps);
+    REQUIRE(stats.calls[CriminisiStats::PHASE_INITIALIZE] == 2);
+    REQUIRE(stats.calls[CriminisiStats::PHASE_TARGET_SELECTION] == stats.steps);
+    REQUIRE(stats.calls[CriminisiStats::PHASE_SOURCE_SEARCH] == stats.steps);
+    REQUIRE(stats.calls[CriminisiStats::PHASE_PROPAGATION] == stats.patches);
+    REQUIRE(stats.calls[CriminisiStats::PHASE_CANDIDATE_FILTER] >= stats.steps);
+    REQUIRE(stats.candidatesTested > 0);
+    for (int i = 0; i < CriminisiStats::PHASE_COUNT; ++i) {
+        REQUIRE(stats.seconds[i] >= 0);
+    }
+
+    // Nothing is recorded unless enabled.
+    CriminisiInpainter inpainter;
+    inpainter.setSourceImage(img);
+    inpainter.setTargetMask(mask);
+    inpainter.initialize();
+    inpaintAll(inpainter);
+    REQUIRE(inpainter.stats().seconds[CriminisiStats::PHASE_SOURCE_SEARCH] == 0);
+    REQUIRE(inpainter.stats().steps > 0);
+}
+
+/** Records reported progress. */
+class RecordingObserver : public ProgressObserver {
+public:
+    void progress(float fraction)
+    {
+        fractions.push_back(fraction);
+    }
+
+    std::vector<float> fractions;
+};
+
+/** Fails on the given progress report. */
+class FailingObserver : public ProgressObserver {
+public:
+    FailingObserver(int failAt)
+        : calls(0), _failAt(failAt)
+    {}
+
+    void progress(float)
+    {
+        if (++calls == _failAt)
+            CV_Error(cv::Error::StsError, "Observer failed");
+    }
+
+    int calls;
+
+private:
+    int _failAt;
+};
+
+TEST_CASE("criminisi-budget")
+{
+    cv::Mat img = randomLinesColorImage(100, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(40, 40, 20, 15));
+
+    // An exhausted budget switches to quick search right after the first step, but still completes.
+    RecordingObserver observer;
+    cv::Mat result = img.clone();
+    REQUIRE(inpaintCriminisiBudgeted(result, mask, cv::Mat(), 9, 0.0, 0, &observer));
+    REQUIRE(cv::norm(result, img, cv::NORM_L1, 255 - mask) == 0);
+
+    REQUIRE(!observer.fractions.empty());
+    for (size_t i = 1; i < observer.fractions.size(); ++i) {
+        REQUIRE(observer.fractions[i] >= observer.fractions[i - 1]);
+    }
+    REQUIRE(observer.fractions.back() == 1.f);
+
+    // Without a budget, results equal the regular loop.
+    cv::Mat expected = img.clone();
+    inpaintCriminisi(expected, mask, cv::Mat(), 9);
+    result = img.clone();
+    REQUIRE(inpaintCriminisiBudgeted(result, mask, cv::Mat(), 9, -1.0));
+    REQUIRE(cv::norm(result, expected) == 0);
+
+    // Cancellation stops before the next step.
+    CancellationToken cancel;
+    cancel.cancel();
+
+    CriminisiInpainter inpainter;
+    inpainter.setSourceImage(img);
+    inpainter.setTargetMask(mask);
+    inpainter.initialize();
+    REQUIRE(inpainter.progress() == 0.f);
+    REQUIRE(!inpainter.run(-1, &cancel));
+    REQUIRE(inpainter.hasMoreSteps());
+
+    cancel.reset();
+    REQUIRE(inpainter.run(-1, &cancel));
+    REQUIRE(inpainter.progress() == 1.f);
+
+    // A run aborted after switching to quick search does not leave later runs in quick search.
+    FailingObserver failing(2);
+    inpainter.setPatchSize(9);
+    inpainter.initialize();
+    REQUIRE_THROWS_AS(inpainter.run(0.0, 0, &failing), const cv::Exception &);
+    REQUIRE(failing.calls == 2);
+
+    inpainter.initialize();
+    REQUIRE(inpainter.run());
+    REQUIRE(cv::norm(inpainter.image(), expected) == 0);
+}
+
+TEST_CASE("criminisi-pixel-types")
+{
+    cv::Mat gray = randomLinesImage(80, 20);
+    cv::Mat mask = rectangleMask(gray.size(), cv::Rect(30, 30, 15, 10));
+
+    cv::Mat color;
+    cv::cvtColor(gray, color, cv::COLOR_GRAY2BGR);
+
+    cv::Mat images[4];
+    gray.copyTo(images[0]);
+    color.convertTo(images[1], CV_16U, 257);
+    gray.convertTo(images[2], CV_32F, 1 / 255.);
+    color.convertTo(images[3], CV_32F, 1 / 255.);
+
+    // Values of holes in floating point images are commonly undefined.
+    images[2].setTo(std::numeric_limits<float>::quiet_NaN(), mask);
+
+    for (int i = 0; i < 4; ++i) {
+        CriminisiInpainter inpainter;
+        inpainter.setSourceImage(images[i]);
+        inpainter.setTargetMask(mask);
+        inpainter.setPatchSize(9);
+        inpainter.initialize();
+
+        inpaintAll(inpainter);
+
+        cv::Mat result = inpainter.image();
+        REQUIRE(result.type() == images[i].type());
+        REQUIRE(cv::countNonZero(inpainter.targetRegion()) == 0);
+
+        // Known pixels are untouched and filled pixels are exact copies of known ones.
+        cv::Mat result8, image8;
+        const double scale = result.depth() == CV_16U ? 1 / 257. : (result.depth() == CV_32F ? 255. : 1.);
+        result.convertTo(result8, CV_8U, scale);
+        images[i].convertTo(image8, CV_8U, scale);
+        REQUIRE(cv::norm(result8, image8, cv::NORM_L1, 255 - mask) == 0);
+
+        cv::Mat back;
+        result8.convertTo(back, result.depth(), 1 / scale);
+        REQUIRE(cv::norm(back, result, cv::NORM_INF) < 1e-6);
+    }
+}
+
+TEST_CASE("criminisi-border")
+{
+    cv::Mat img = randomLinesColorImage(80, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(0, 0, 12, 8));
+    cv::rectangle(mask, cv::Rect(60, 70, 20, 10), cv::Scalar(255), -1);
+
+    CriminisiInpainter inpainter;
+    inpainter.setSourceImage(img);
+    inpainter.setTargetMask(mask);
+    inpainter.setPatchSize(9);
+    inpainter.initialize();
+
+    inpaintAll(inpainter);
+
+    // Holes touching the image border are filled completely.
+    REQUIRE(inpainter.image().size() == img.size());
+    REQUIRE(cv::countNonZero(inpainter.targetRegion()) == 0);
+
+    REQUIRE(changedKnownPixels(img, inpainter.image(), mask) == 0);
+
+    // Offsets point to source locations within the image.
+    cv::Mat_<cv::Vec2i> offsets = inpainter.sourceOffsets();
+    for (int y = 0; y < mask.rows; ++y) {
+        for (int x = 0; x < mask.cols; ++x) {
+            if (mask.at<uchar>(y, x) == 0)
+                continue;
+            const cv::Point s(x + offsets(y, x)[0], y + offsets(y, x)[1]);
+            REQUIRE(cv::Rect(0, 0, img.cols, img.rows).contains(s));
+        }
+    }
+}
+
+TEST_CASE("criminisi-no-source")
+{
+    cv::Mat img = randomLinesColorImage(80, 20);
+
+    // The known frame is too thin to hold a single source patch.
+    cv::Mat mask(img.size(), CV_8UC1);
+    mask.setTo(255);
+    cv::rectangle(mask, cv::Rect(0, 0, 80, 80), cv::Scalar(0), 3);
+
+    CriminisiInpainter inpainter;
+    inpainter.setSourceImage(img);
+    inpainter.setTargetMask(mask);
+    inpainter.setPatchSize(9);
+    inpainter.initialize();
+
+    REQUIRE(inpainter.hasMoreSteps());
+    REQUIRE_THROWS_AS(inpainter.step(), const cv::Exception &);
+}
+
+TEST_CASE("criminisi-roi-source-mask")
+{
+    cv::Mat img = randomLinesColorImage(160, 40);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(100, 40, 15, 10));
+
+    // Any non-negative margin leaves room for source patches around the target.
+    cv::Mat result = img.clone();
+    inpaintCriminisi(result, mask, cv::Mat(), 9, 1, 0);
+
+    REQUIRE(changedKnownPixels(img, result, mask) == 0);
+
+    // A source mask allowing pixels outside the crop only is still respected.
+    cv::Mat source(img.size(), CV_8UC1);
+    source.setTo(0);
+    source(cv::Rect(0, 120, 40, 40)).setTo(255);
+    img(cv::Rect(0, 110, 50, 50)).setTo(cv::Scalar(10, 20, 30));
+
+    result = img.clone();
+    inpaintCriminisi(result, mask, source, 9, 1, 0);
+
+    std::vector<cv::Point> filled;
+    cv::findNonZero(mask, filled);
+    for (size_t i = 0; i < filled.size(); ++i) {
+        REQUIRE(result.at<cv::Vec3b>(filled[i]) == cv::Vec3b(10, 20, 30));
+    }
+}
+
+TEST_CASE("criminisi-projection-pruning")
+{
+    cv::Mat img = randomLinesColorImage(80, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(30, 30, 15, 10));
+
+    // Pruning only rejects candidates that cannot be the best match.
+    cv::Mat results[2];
+    for (int i = 0; i < 2; ++i) {
+        CriminisiInpainter inpainter;
+        inpainter.setSourceImage(img);
+        inpainter.setTargetMask(mask);
+        inpainter.setPatchSize(9);
+        inpainter.setProjectionPruning(i == 1);
+        inpainter.initialize();
+
+        inpaintAll(inpainter);
+
+        results[i] = inpainter.image().clone();
+    }
+
+    REQUIRE(cv::norm(results[0], results[1]) == 0);
+}
+
+TEST_CASE("criminisi-reuse-source-centers")
+{
+    cv::Mat img = randomLinesColorImage(80, 20);
+    cv::Mat masks[2];
+    for (int i = 0; i < 2; ++i) {
+        masks[i].create(img.size(), CV_8UC1);
+        masks[i].setTo(0);
+    }
+    cv::rectangle(masks[0], cv::Rect(30, 30, 15, 10), cv::Scalar(255), -1);
+    cv::rectangle(masks[1], cv::Rect(10, 50, 20, 20), cv::Scalar(255), -1);
+
+    // Source centers are recomputed after masks changed in a search mode that does not use them.
+    CriminisiInpainter inpainter;
+    const int masksUsed[] = {0, 1, 1};
+    const int searches[] = {CriminisiInpainter::SOURCE_SEARCH_PATCHMATCH, CriminisiInpainter::SOURCE_SEARCH_EXHAUSTIVE, CriminisiInpainter::SOURCE_SEARCH_PATCHMATCH};
+    for (int i = 0; i < 3; ++i) {
+        inpainter.setSourceImage(img);
+        inpainter.setTargetMask(masks[masksUsed[i]]);
+        inpainter.setSourceSearch(searches[i]);
+        inpainter.initialize();
+        inpaintAll(inpainter);
+    }
+
+    CriminisiInpainter fresh;
+    fresh.setSourceImage(img);
+    fresh.setTargetMask(masks[1]);
+    fresh.setSourceSearch(CriminisiInpainter::SOURCE_SEARCH_PATCHMATCH);
+    fresh.initialize();
+    inpaintAll(fresh);
+
+    REQUIRE(cv::norm(inpainter.image(), fresh.image()) == 0);
+}
+
+TEST_CASE("criminisi-roi-isolated")
+{
+    cv::Mat img = randomLinesColorImage(120, 30);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(50, 40, 30, 12));
+
+    // The target continues beyond the region of interest. Pixels outside it must not leak into the padding.
+    const cv::Rect roi(30, 20, 40, 60);
+
+    CriminisiInpainter viewed;
+    viewed.setSourceImage(img(roi));
+    viewed.setTargetMask(mask(roi));
+    viewed.setPatchSize(9);
+    viewed.initialize();
+    inpaintAll(viewed);
+
+    CriminisiInpainter copied;
+    copied.setSourceImage(img(roi).clone());
+    copied.setTargetMask(mask(roi).clone());
+    copied.setPatchSize(9);
+    copied.initialize();
+    inpaintAll(copied);
+
+    REQUIRE(cv::countNonZero(viewed.targetRegion()) == 0);
+    REQUIRE(cv::norm(viewed.image(), copied.image()) == 0);
+}
@@ -0,0 +1,69 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "catch.hpp"
+#include "random_testdata.h"
+
+#include <inpaint/criminisi_video.h>
+#include <opencv2/opencv.hpp>
+
+using namespace Inpaint;
+
+TEST_CASE("criminisi-video")
+{
+    cv::Mat img = randomLinesColorImage(100, 20);
+    cv::Mat mask = rectangleMask(img.size(), cv::Rect(40, 40, 15, 10));
+
+    cv::Mat expected = img.clone();
+    inpaintCriminisi(expected, mask, cv::Mat(), 9);
+
+    // Priors only tighten bounds of the exhaustive search, so results match a cold run.
+    CriminisiVideoInpainter video;
+    video.inpainter().setPatchSize(9);
+    for (int i = 0; i < 3; ++i) {
+        cv::Mat frame = img.clone();
+        video.process(frame, mask);
+        REQUIRE(cv::norm(frame, expected) == 0);
+    }
+
+    // Restricted to the previous match, identical frames reproduce the previous result.
+    video.setSearchRadius(0);
+    video.inpainter().setSearchErrorThreshold(1e9f);
+    cv::Mat frame = img.clone();
+    video.process(frame, mask);
+    REQUIRE(cv::norm(frame, expected) == 0);
+
+    // Moving mask
+    cv::Mat moved(img.size(), CV_8UC1);
+    moved.setTo(0);
+    cv::rectangle(moved, cv::Rect(44, 42, 15, 10), cv::Scalar(255), -1);
+    video.setSearchRadius(4);
+    frame = img.clone();
+    video.process(frame, moved);
+
+    CriminisiInpainter &ci = video.inpainter();
+    REQUIRE(cv::countNonZero(ci.targetRegion()) == 0);
+    REQUIRE(cv::norm(frame, img, cv::NORM_L1, 255 - moved) == 0);
+
+    video.reset();
+    frame = img.clone();
+    video.process(frame, moved);
+    REQUIRE(cv::countNonZero(ci.targetRegion()) == 0);
+}
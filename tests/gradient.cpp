@@ -58,3 +58,25 @@ TEST_CASE("gradient")
         }
     }
 }
+
+TEST_CASE("gradient-batch")
+{
+    cv::Mat img = randomLinesImage(50, 50);
+
+    std::vector<cv::Point> points;
+    for (int y = 1; y < img.rows - 1; y += 3) {
+        for (int x = 1; x < img.cols - 1; x += 2) {
+            points.push_back(cv::Point(x, y));
+        }
+    }
+
+    const int n = static_cast<int>(points.size());
+    std::vector<float> gx(n), gy(n);
+    normalizedGradients(img, &points[0], n, &gx[0], &gy[0]);
+
+    for (int i = 0; i < n; ++i) {
+        cv::Vec2f gref = normalizedGradient(img, points[i].y, points[i].x);
+        REQUIRE(gx[i] == Approx(gref[0]));
+        REQUIRE(gy[i] == Approx(gref[1]));
+    }
+}
@@ -0,0 +1,98 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.hpp"
+
+#include <inpaint/indexed_heap.h>
+#include <opencv2/opencv.hpp>
+#include <map>
+
+using namespace Inpaint;
+
+TEST_CASE("indexed-heap")
+{
+    IndexedMaxHeap h;
+    h.reset(10);
+    REQUIRE(h.empty());
+
+    h.push(3, 1.f);
+    h.push(7, 5.f);
+    h.push(1, 5.f);
+    h.push(4, 2.f);
+    REQUIRE(h.size() == 4);
+    
+    // Ties resolve to smaller key
+    REQUIRE(h.top() == 1);
+    REQUIRE(h.topPriority() == 5.f);
+
+    // Decrease key
+    h.push(1, 0.5f);
+    REQUIRE(h.top() == 7);
+
+    // Increase key
+    h.push(3, 10.f);
+    REQUIRE(h.top() == 3);
+
+    h.remove(3);
+    REQUIRE(!h.contains(3));
+    REQUIRE(h.top() == 7);
+
+    h.pop();
+    REQUIRE(h.top() == 4);
+    h.pop();
+    REQUIRE(h.top() == 1);
+    h.pop();
+    REQUIRE(h.empty());
+}
+
+TEST_CASE("indexed-heap-random")
+{
+    IndexedMaxHeap h;
+    h.reset(100);
+    std::map<int, float> ref;
+
+    cv::RNG rng(10);
+    for (int i = 0; i < 10000; ++i) {
+        const int key = rng.uniform(0, 100);
+        const int op = rng.uniform(0, 3);
+
+        if (op < 2) {
+            const float prio = (float)rng.uniform(0, 20);
+            h.push(key, prio);
+            ref[key] = prio;
+        } else {
+            h.remove(key);
+            ref.erase(key);
+        }
+
+        REQUIRE(h.size() == (int)ref.size());
+
+        if (!ref.empty()) {
+            int bestKey = -1;
+            float bestPrio = -1;
+            for (std::map<int, float>::const_iterator iter = ref.begin(); iter != ref.end(); ++iter) {
+                if (iter->second > bestPrio) {
+                    bestPrio = iter->second;
+                    bestKey = iter->first;
+                }
+            }
+            REQUIRE(h.top() == bestKey);
+        }
+    }
+}
@@ -21,6 +21,7 @@
 #include "random_testdata.h"
 
 #include <inpaint/patch.h>
+#include <inpaint/patch_kernels.h>
 #include <opencv2/opencv.hpp>
 
 using namespace Inpaint;
@@ -142,3 +143,50 @@ TEST_CASE("patch-comparable-regions")
     REQUIRE(p.first.tl() == cv::Point(8, 8));
     REQUIRE(p.second.tl() == cv::Point(17, 17));
 }
+
+/** Compare masked copy and fill kernels of half size H against OpenCV. */
+template<int H>
+void checkMaskedPatchKernels(const cv::Mat &img, const cv::Mat &mask, int halfSize)
+{
+    const cv::Point s(8, 9), t(20, 18);
+    const cv::Rect sr(s.x - halfSize, s.y - halfSize, 2 * halfSize + 1, 2 * halfSize + 1);
+    const cv::Rect tr(t.x - halfSize, t.y - halfSize, 2 * halfSize + 1, 2 * halfSize + 1);
+
+    cv::Mat expected = img.clone();
+    cv::Mat expectedRoi = expected(tr);
+    img(sr).copyTo(expectedRoi, mask(tr));
+
+    cv::Mat result = img.clone();
+    copyMaskedPatch<H>(img, s, result, t, mask, halfSize);
+    REQUIRE(cv::norm(result, expected, cv::NORM_INF) == 0);
+
+    cv::Mat_<float> values(img.size());
+    values.setTo(0);
+    fillMaskedPatch<H>(values, t, mask, 2.f, halfSize);
+    REQUIRE(cv::countNonZero(values) == cv::countNonZero(mask(tr)));
+    REQUIRE(cv::sum(values)[0] == 2 * cv::countNonZero(mask(tr)));
+
+    cv::Mat cleared = mask.clone();
+    REQUIRE(clearMaskedPatch<H>(cleared, t, halfSize) == cv::countNonZero(mask(tr)));
+    REQUIRE(cv::countNonZero(cleared(tr)) == 0);
+    REQUIRE(cv::countNonZero(cleared) == cv::countNonZero(mask) - cv::countNonZero(mask(tr)));
+}
+
+TEST_CASE("patch-masked-kernels")
+{
+    cv::Mat gray = uniformRandomNoiseImage(31);
+    cv::Mat mask = uniformRandomNoiseImage(31) > 100;
+
+    cv::Mat images[3];
+    gray.copyTo(images[0]);
+    cv::cvtColor(gray, images[1], cv::COLOR_GRAY2BGR);
+    images[1].convertTo(images[2], CV_32F);
+
+    for (int i = 0; i < 3; ++i) {
+        checkMaskedPatchKernels<2>(images[i], mask, 2);
+        checkMaskedPatchKernels<5>(images[i], mask, 5);
+        for (int h = 1; h < 8; ++h) {
+            checkMaskedPatchKernels<-1>(images[i], mask, h);
+        }
+    }
+}
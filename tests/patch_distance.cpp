@@ -0,0 +1,116 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.hpp"
+#include "random_testdata.h"
+
+#include <inpaint/patch_distance.h>
+#include <inpaint/patch.h>
+#include <opencv2/opencv.hpp>
+
+using namespace Inpaint;
+
+TEST_CASE("patch-distance")
+{
+    cv::Mat img = uniformRandomNoiseImage(60);
+    cv::Mat imgColor(60, 60, CV_8UC3);
+    cv::randu(imgColor, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    const cv::Mat images[] = {img, imgColor};
+    const int norms[] = {cv::NORM_L1, cv::NORM_L2SQR};
+
+    cv::RNG rng(10);
+    for (int i = 0; i < 2; ++i) {
+        for (int n = 0; n < 2; ++n) {
+            for (int halfSize = 1; halfSize < 12; ++halfSize) {
+                cv::Mat templ = centeredPatch(images[i], 30, 30, halfSize);
+                cv::Mat mask(templ.size(), CV_8UC1);
+                for (int k = 0; k < mask.rows * mask.cols; ++k) {
+                    mask.at<uchar>(k) = rng.uniform(0, 3) > 0 ? 255 : 0;
+                }
+
+                MaskedPatchDistance d;
+                d.setNormType(norms[n]);
+                d.setTemplate(templ, mask);
+
+                for (int k = 0; k < 20; ++k) {
+                    int y = rng.uniform(0, images[i].rows - templ.rows + 1);
+                    int x = rng.uniform(0, images[i].cols - templ.cols + 1);
+                    cv::Mat patch = topLeftPatch(images[i], y, x, templ.rows, templ.cols);
+
+                    const int64 ref = (int64)cv::norm(templ, patch, norms[n], mask);
+                    REQUIRE(d(images[i], y, x) == ref);
+
+                    // Early termination
+                    REQUIRE(d(images[i], y, x, ref) == ref);
+                    REQUIRE(d(images[i], y, x, ref + 1) == ref);
+                    if (ref > 0) {
+                        REQUIRE(d(images[i], y, x, ref - 1) > ref - 1);
+                    }
+                }
+
+                // Without mask
+                d.setTemplate(templ, cv::Mat());
+                cv::Mat patch = topLeftPatch(images[i], 0, 0, templ.rows, templ.cols);
+                REQUIRE(d(images[i], 0, 0) == (int64)cv::norm(templ, patch, norms[n]));
+            }
+        }
+    }
+}
+
+TEST_CASE("patch-distance-16bit")
+{
+    cv::Mat img(60, 60, CV_16UC1);
+    cv::Mat imgColor(60, 60, CV_16UC3);
+    cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(65535));
+    cv::randu(imgColor, cv::Scalar::all(0), cv::Scalar::all(65535));
+
+    const cv::Mat images[] = {img, imgColor};
+    const int norms[] = {cv::NORM_L1, cv::NORM_L2SQR};
+
+    cv::RNG rng(10);
+    for (int i = 0; i < 2; ++i) {
+        for (int n = 0; n < 2; ++n) {
+            for (int halfSize = 1; halfSize < 8; ++halfSize) {
+                cv::Mat templ = centeredPatch(images[i], 30, 30, halfSize);
+                cv::Mat mask(templ.size(), CV_8UC1);
+                for (int k = 0; k < mask.rows * mask.cols; ++k) {
+                    mask.at<uchar>(k) = rng.uniform(0, 3) > 0 ? 255 : 0;
+                }
+
+                MaskedPatchDistance d;
+                d.setNormType(norms[n]);
+                d.setTemplate(templ, mask);
+
+                for (int k = 0; k < 20; ++k) {
+                    int y = rng.uniform(0, images[i].rows - templ.rows + 1);
+                    int x = rng.uniform(0, images[i].cols - templ.cols + 1);
+                    cv::Mat patch = topLeftPatch(images[i], y, x, templ.rows, templ.cols);
+
+                    const int64 ref = (int64)cv::norm(templ, patch, norms[n], mask);
+                    REQUIRE(d(images[i], y, x) == ref);
+                    REQUIRE(d(images[i], y, x, ref) == ref);
+                    if (ref > 0) {
+                        REQUIRE(d(images[i], y, x, ref - 1) > ref - 1);
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,77 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.hpp"
+#include "random_testdata.h"
+
+#include <inpaint/patch_projections.h>
+#include <inpaint/patch_distance.h>
+#include <inpaint/patch.h>
+#include <opencv2/opencv.hpp>
+
+using namespace Inpaint;
+
+TEST_CASE("patch-projections")
+{
+    cv::Mat img = uniformRandomNoiseImage(60);
+    cv::Mat imgColor(60, 60, CV_8UC3);
+    cv::randu(imgColor, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    const cv::Mat images[] = {img, imgColor};
+    const int norms[] = {cv::NORM_L1, cv::NORM_L2SQR};
+
+    // The largest size needs more partitions to keep block sums within 16 bits.
+    const int halfSizes[] = {1, 2, 3, 4, 5, 6, 7, 20};
+
+    cv::RNG rng(10);
+    for (int i = 0; i < 2; ++i) {
+        for (int h = 0; h < 8; ++h) {
+            const int halfSize = halfSizes[h];
+            cv::Mat mask(images[i].size(), CV_8UC1);
+            mask.setTo(0);
+            mask(cv::Rect(halfSize, halfSize, 60 - 2 * halfSize, 60 - 2 * halfSize)).setTo(255);
+
+            PatchProjections p;
+            p.build(images[i], mask, halfSize);
+            REQUIRE(!p.empty());
+
+            cv::Mat templ = centeredPatch(images[i], 30, 30, halfSize).clone();
+            cv::Mat templMask(templ.size(), CV_8UC1);
+            templMask.setTo(255);
+            templMask(cv::Rect(0, 0, templ.cols, templ.rows / 2)).setTo(0);
+
+            for (int n = 0; n < 2; ++n) {
+                MaskedPatchDistance d;
+                d.setNormType(norms[n]);
+                d.setTemplate(templ, templMask);
+
+                PatchProjections::Template t;
+                p.project(templ, templMask, norms[n], t);
+
+                // The bound never exceeds the exact distance, and is tight for the template position itself.
+                for (int k = 0; k < 50; ++k) {
+                    const int y = rng.uniform(halfSize, 60 - halfSize);
+                    const int x = rng.uniform(halfSize, 60 - halfSize);
+                    REQUIRE(p.lowerBound(t, y, x) <= d(images[i], y - halfSize, x - halfSize));
+                }
+                REQUIRE(p.lowerBound(t, 30, 30) == 0);
+            }
+        }
+    }
+}
@@ -41,6 +41,21 @@ inline cv::Mat randomLinesImage(int imageSize, int nLines)
     return m;
 }
 
+inline cv::Mat randomLinesColorImage(int imageSize, int nLines)
+{
+    cv::Mat m;
+    cv::cvtColor(randomLinesImage(imageSize, nLines), m, cv::COLOR_GRAY2BGR);
+    return m;
+}
+
+inline cv::Mat rectangleMask(cv::Size size, cv::Rect r)
+{
+    cv::Mat m(size, CV_8UC1);
+    m.setTo(0);
+    m(r & cv::Rect(0, 0, size.width, size.height)).setTo(255);
+    return m;
+}
+
 inline cv::Mat uniformRandomNoiseImage(int imageSize)
 {
     cv::Mat m(imageSize, imageSize, CV_8UC1);
@@ -0,0 +1,97 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.hpp"
+#include "random_testdata.h"
+
+#include <inpaint/source_patch_index.h>
+#include <inpaint/patch.h>
+#include <opencv2/opencv.hpp>
+
+using namespace Inpaint;
+
+TEST_CASE("source-patch-index")
+{
+    cv::Mat img(80, 80, CV_8UC3);
+    cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(img, img, cv::Size(5, 5), 0);
+
+    const int halfSize = 5;
+    std::vector<cv::Point> centers;
+    for (int y = halfSize; y < img.rows - halfSize; ++y) {
+        for (int x = halfSize; x < img.cols - halfSize; ++x) {
+            centers.push_back(cv::Point(x, y));
+        }
+    }
+
+    SourcePatchIndex index;
+    index.build(img, centers, halfSize);
+    REQUIRE(!index.empty());
+
+    std::vector<cv::Point> neighbors;
+    SourcePatchIndex::Workspace ws;
+    const cv::Point queries[] = {cv::Point(20, 20), cv::Point(50, 31), cv::Point(70, 60)};
+
+    for (int i = 0; i < 3; ++i) {
+        const cv::Point p = queries[i];
+        cv::Mat templ = centeredPatch(img, p.y, p.x, halfSize);
+
+        // A fully known indexed patch is found along the first descent.
+        REQUIRE(index.query(templ, cv::Mat(), 4, 64, neighbors, ws));
+        REQUIRE(neighbors.size() == 4);
+        REQUIRE(neighbors[0] == p);
+
+        // Partially known patches are found when enough descriptors are compared.
+        cv::Mat mask(templ.size(), CV_8UC1);
+        mask.setTo(0);
+        mask(cv::Rect(0, 0, templ.cols, templ.rows / 2)).setTo(255);
+
+        REQUIRE(index.query(templ, mask, 4, static_cast<int>(centers.size()), neighbors, ws));
+        REQUIRE(std::find(neighbors.begin(), neighbors.end(), p) != neighbors.end());
+
+        // Nothing to compare when no block is entirely known.
+        mask.setTo(0);
+        REQUIRE(!index.query(templ, mask, 4, 64, neighbors, ws));
+        REQUIRE(neighbors.empty());
+    }
+}
+
+TEST_CASE("source-patch-index-small-patches")
+{
+    cv::Mat img(40, 40, CV_8UC1);
+    cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    // Patches of side 3 use fewer partitions than the default.
+    const int halfSize = 1;
+    std::vector<cv::Point> centers;
+    for (int y = halfSize; y < img.rows - halfSize; ++y) {
+        for (int x = halfSize; x < img.cols - halfSize; ++x) {
+            centers.push_back(cv::Point(x, y));
+        }
+    }
+
+    SourcePatchIndex index;
+    index.build(img, centers, halfSize);
+    REQUIRE(!index.empty());
+
+    std::vector<cv::Point> neighbors;
+    SourcePatchIndex::Workspace ws;
+    REQUIRE(index.query(centeredPatch(img, 20, 20, halfSize), cv::Mat(), 1, static_cast<int>(centers.size()), neighbors, ws));
+    REQUIRE(neighbors.size() == 1);
+}
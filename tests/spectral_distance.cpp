@@ -0,0 +1,72 @@
+/**
+   This file is part of Inpaint.
+
+   Copyright Christoph Heindl 2014
+
+   Inpaint is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Inpaint is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Inpaint.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.hpp"
+#include "random_testdata.h"
+
+#include <inpaint/spectral_distance.h>
+#include <inpaint/patch_distance.h>
+#include <inpaint/patch.h>
+#include <opencv2/opencv.hpp>
+
+using namespace Inpaint;
+
+TEST_CASE("spectral-distance")
+{
+    cv::Mat img = uniformRandomNoiseImage(60);
+    cv::Mat imgColor(50, 70, CV_8UC3);
+    cv::randu(imgColor, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    const cv::Mat images[] = {img, imgColor};
+
+    cv::RNG rng(10);
+    for (int i = 0; i < 2; ++i) {
+        const cv::Mat &image = images[i];
+
+        for (int halfSize = 2; halfSize < 12; halfSize += 3) {
+            const int size = 2 * halfSize + 1;
+
+            cv::Mat templ = centeredPatch(image, 25, 25, halfSize).clone();
+            cv::Mat mask(templ.size(), CV_8UC1);
+            for (int k = 0; k < mask.rows * mask.cols; ++k) {
+                mask.at<uchar>(k) = rng.uniform(0, 3) > 0 ? 255 : 0;
+            }
+
+            SpectralPatchDistance sd;
+            sd.setImage(image, cv::Size(size, size));
+
+            cv::Mat_<double> distances;
+            SpectralPatchDistance::Workspace ws;
+            sd.compute(templ, mask, distances, ws);
+
+            REQUIRE(distances.cols == image.cols - size + 1);
+            REQUIRE(distances.rows == image.rows - size + 1);
+
+            MaskedPatchDistance d;
+            d.setNormType(cv::NORM_L2SQR);
+            d.setTemplate(templ, mask);
+
+            for (int y = 0; y < distances.rows; ++y) {
+                for (int x = 0; x < distances.cols; ++x) {
+                    REQUIRE(std::abs(distances(y, x) - (double)d(image, y, x)) < 0.5);
+                }
+            }
+        }
+    }
+}